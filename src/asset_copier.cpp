@@ -0,0 +1,151 @@
+#include "asset_copier.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+using neng::Error;
+
+bool is_up_to_date(const struct stat &source, const struct stat &destination,
+                   neng::AssetCopyMode mode) {
+    if (mode == neng::AssetCopyMode::HARDLINK) {
+        return source.st_dev == destination.st_dev &&
+               source.st_ino == destination.st_ino;
+    }
+
+    // A hardlink left over from a HARDLINK build matches the source in every
+    // way, but a copy is what was asked for.
+    const bool same_file = source.st_dev == destination.st_dev &&
+                           source.st_ino == destination.st_ino;
+
+    return !same_file && source.st_size == destination.st_size &&
+           source.st_mtim.tv_sec == destination.st_mtim.tv_sec &&
+           source.st_mtim.tv_nsec == destination.st_mtim.tv_nsec;
+}
+
+Error buffered_copy(int source_fd, int destination_fd) {
+    char buffer[64 * 1024];
+
+    for (;;) {
+        const auto bytes_read = read(source_fd, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            return Error::FILE_READ_ERROR;
+        }
+
+        if (bytes_read == 0) {
+            return Error::OK;
+        }
+
+        for (ssize_t written = 0; written < bytes_read;) {
+            const auto result = write(destination_fd, buffer + written,
+                                      bytes_read - written);
+            if (result < 0) {
+                return Error::FILE_WRITE_ERROR;
+            }
+            written += result;
+        }
+    }
+}
+
+// Copies the contents without them ever leaving the kernel, if possible.
+Error copy_contents(int source_fd, int destination_fd, off_t size) {
+#ifdef __linux__
+    if (ioctl(destination_fd, FICLONE, source_fd) == 0) {
+        return Error::OK;
+    }
+
+    off_t copied = 0;
+    while (copied < size) {
+        const auto result = copy_file_range(source_fd, nullptr, destination_fd,
+                                            nullptr, size - copied, 0);
+        if (result < 0) {
+            if (copied == 0 &&
+                (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                 errno == EOPNOTSUPP)) {
+                break;
+            }
+            return Error::FILE_WRITE_ERROR;
+        }
+
+        if (result == 0) {
+            // The source shrank while it was being copied.
+            return Error::OK;
+        }
+
+        copied += result;
+    }
+
+    if (copied > 0 || size == 0) {
+        return Error::OK;
+    }
+#endif
+
+    return buffered_copy(source_fd, destination_fd);
+}
+} // namespace
+
+namespace neng {
+Error copy_asset(const fs::path &source, const fs::path &destination,
+                 AssetCopyMode mode) {
+    const int source_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    struct stat source_stat;
+    struct stat destination_stat;
+    if (fstat(source_fd, &source_stat) != 0) {
+        close(source_fd);
+        return Error::FILE_READ_ERROR;
+    }
+
+    if (stat(destination.c_str(), &destination_stat) == 0) {
+        if (is_up_to_date(source_stat, destination_stat, mode)) {
+            close(source_fd);
+            return Error::OK;
+        }
+
+        // The old output might be a hardlink to the input, in which case
+        // writing through it would overwrite the input as well.
+        unlink(destination.c_str());
+    }
+
+    if (mode == AssetCopyMode::HARDLINK &&
+        link(source.c_str(), destination.c_str()) == 0) {
+        close(source_fd);
+        return Error::OK;
+    }
+
+    const int destination_fd =
+        open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+             source_stat.st_mode & 0777);
+    if (destination_fd < 0) {
+        close(source_fd);
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    auto error = copy_contents(source_fd, destination_fd, source_stat.st_size);
+
+    if (error == Error::OK) {
+        const struct timespec times[2] = {source_stat.st_atim,
+                                          source_stat.st_mtim};
+        futimens(destination_fd, times);
+    }
+
+    close(source_fd);
+    if (close(destination_fd) != 0 && error == Error::OK) {
+        error = Error::FILE_WRITE_ERROR;
+    }
+
+    return error;
+}
+} // namespace neng
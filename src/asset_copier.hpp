@@ -0,0 +1,22 @@
+#pragma once
+
+#include "document.hpp"
+
+namespace neng {
+enum class AssetCopyMode {
+    // Reflinks where the filesystem supports them, copy_file_range elsewhere,
+    // and a plain buffered copy as a last resort.
+    COPY,
+    // Hardlinks the output to the input, copying only when that fails (say,
+    // because they are on different filesystems).
+    HARDLINK,
+};
+
+// Mirrors `source` to `destination`, whose directory must already exist. A
+// destination with the same size and modification time as the source is
+// assumed to be up to date and left alone, so a copy also carries the source's
+// modification time over. In COPY mode, a hardlink to the source is never up
+// to date.
+Error copy_asset(const std::filesystem::path &source,
+                 const std::filesystem::path &destination, AssetCopyMode mode);
+} // namespace neng
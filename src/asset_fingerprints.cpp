@@ -0,0 +1,224 @@
+#include "asset_fingerprints.hpp"
+#include "string_utils.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+using neng::Error;
+
+std::string to_hex(uint64_t value) {
+    std::string hex(16, '0');
+    char digits[16];
+    const auto end = std::to_chars(digits, digits + sizeof(digits), value, 16).ptr;
+    std::copy(digits, end, hex.end() - (end - digits));
+    return hex;
+}
+
+// Hashes the file a block at a time, so that big images never have to be in
+// memory all at once.
+std::tuple<uint64_t, Error> hash_file(const fs::path &path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {0, Error::FILE_OPEN_ERROR};
+    }
+
+    auto hash = neng::FNV_OFFSET_BASIS;
+    char buffer[64 * 1024];
+
+    for (;;) {
+        const auto bytes_read = read(fd, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            close(fd);
+            return {0, Error::FILE_READ_ERROR};
+        }
+
+        if (bytes_read == 0) {
+            break;
+        }
+
+        hash = neng::fnv1a_hash({buffer, static_cast<size_t>(bytes_read)}, hash);
+    }
+
+    close(fd);
+    return {hash, Error::OK};
+}
+
+// Paths have to stay inside of the pages directory.
+bool is_valid_asset_path(std::string_view path) {
+    if (path.empty()) {
+        return false;
+    }
+
+    for (const auto &part : neng::split_string(path, "/")) {
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// css/site.css -> css/site.<hash>.css
+std::string fingerprinted_name(std::string_view path, uint64_t hash) {
+    const auto directory_end = path.find_last_of('/');
+    const auto name_begin =
+        directory_end == std::string_view::npos ? 0 : directory_end + 1;
+    auto extension = path.find_last_of('.');
+    if (extension == std::string_view::npos || extension <= name_begin) {
+        extension = path.size();
+    }
+
+    return std::string(path.substr(0, extension)) + '.' + to_hex(hash) +
+           std::string(path.substr(extension));
+}
+} // namespace
+
+namespace neng {
+void AssetFingerprints::load_cache(const fs::path &cache_path) {
+    std::ifstream file(cache_path);
+    if (!file.is_open()) {
+        return;
+    }
+
+    // One asset per line: path<TAB>size<TAB>modification time<TAB>hash.
+    std::string line;
+    while (std::getline(file, line)) {
+        const auto parts = split_string(line, "\t");
+        if (parts.size() != 4) {
+            continue;
+        }
+
+        CachedHash cached;
+        const auto parse = [](const std::string &part, auto &value,
+                              int base = 10) {
+            const auto [end, error_code] = std::from_chars(
+                part.data(), part.data() + part.size(), value, base);
+            return error_code == std::errc{} &&
+                   end == part.data() + part.size();
+        };
+
+        if (parse(parts[1], cached.size) &&
+            parse(parts[2], cached.modification_time) &&
+            parse(parts[3], cached.hash, 16)) {
+            previous_build.insert_or_assign(parts[0], cached);
+        }
+    }
+}
+
+Error AssetFingerprints::save_cache(const fs::path &cache_path) const {
+    std::ofstream file(cache_path);
+    if (!file.is_open()) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    std::lock_guard lock{mutex};
+    for (const auto &[path, slot] : slots) {
+        if (slot->error != Error::OK) {
+            continue;
+        }
+
+        file << path << '\t' << slot->cached.size << '\t'
+             << slot->cached.modification_time << '\t'
+             << to_hex(slot->cached.hash) << '\n';
+    }
+
+    return file ? Error::OK : Error::FILE_WRITE_ERROR;
+}
+
+std::tuple<std::string, Error>
+AssetFingerprints::resolve(std::string_view relative_path) {
+    if (relative_path.starts_with('/')) {
+        relative_path.remove_prefix(1);
+    }
+
+    if (!is_valid_asset_path(relative_path)) {
+        std::cerr << "[ERROR]: Invalid asset path '" << relative_path << "'\n";
+        return {"", Error::INVALID_SYNTAX};
+    }
+
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard lock{mutex};
+        auto &found = slots[std::string(relative_path)];
+        if (!found) {
+            found = std::make_shared<Slot>();
+        }
+        slot = found;
+    }
+
+    // Whoever gets here first does the hashing; anyone else asking for the
+    // same asset waits for them.
+    std::call_once(slot->once, [&]() {
+        const auto path = pages_path / relative_path;
+
+        struct stat file_stat;
+        if (stat(path.c_str(), &file_stat) != 0) {
+            std::cerr << "[ERROR]: The asset " << path << " does not exist.\n";
+            slot->error = Error::FILE_DOES_NOT_EXIST;
+            return;
+        }
+
+        slot->cached = {
+            .size = file_stat.st_size,
+            .modification_time =
+                file_stat.st_mtim.tv_sec * 1'000'000'000 +
+                file_stat.st_mtim.tv_nsec,
+            // Filled in below.
+            .hash = 0,
+        };
+
+        const auto previous = previous_build.find(std::string(relative_path));
+        if (previous != previous_build.end() &&
+            previous->second.size == slot->cached.size &&
+            previous->second.modification_time ==
+                slot->cached.modification_time) {
+            slot->cached.hash = previous->second.hash;
+        } else {
+            const auto [hash, error] = hash_file(path);
+            if (error != Error::OK) {
+                slot->error = error;
+                return;
+            }
+
+            slot->cached.hash = hash;
+            hashed.fetch_add(1);
+        }
+
+        slot->output =
+            "pages/" + fingerprinted_name(relative_path, slot->cached.hash);
+    });
+
+    if (slot->error != Error::OK) {
+        return {"", slot->error};
+    }
+
+    return {'/' + slot->output, Error::OK};
+}
+
+std::vector<FingerprintedAsset> AssetFingerprints::assets() const {
+    std::vector<FingerprintedAsset> assets;
+
+    {
+        std::lock_guard lock{mutex};
+        for (const auto &[path, slot] : slots) {
+            if (slot->error == Error::OK && !slot->output.empty()) {
+                assets.push_back({
+                    .input = pages_path / path,
+                    .output = slot->output,
+                });
+            }
+        }
+    }
+
+    std::sort(assets.begin(), assets.end(),
+              [](const auto &a, const auto &b) { return a.input < b.input; });
+
+    return assets;
+}
+} // namespace neng
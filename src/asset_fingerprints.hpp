@@ -0,0 +1,69 @@
+#pragma once
+
+#include "document.hpp"
+#include "hash.hpp"
+
+#include <atomic>
+#include <mutex>
+
+namespace neng {
+// An asset referenced from a template, and where its fingerprinted copy goes.
+struct FingerprintedAsset {
+    std::filesystem::path input;
+    // The path of the output relative to the output directory, like
+    // pages/css/site.0123456789abcdef.css.
+    std::string output;
+};
+
+// The hashes of the assets that templates refer to with ${{asset path}}. Each
+// asset is hashed at most once per build, however many templates refer to it,
+// and not at all if the previous build saw it with the same size and
+// modification time. Safe to share between threads.
+class AssetFingerprints {
+  public:
+    explicit AssetFingerprints(std::filesystem::path pages_path)
+        : pages_path{std::move(pages_path)} {}
+
+    // Picks up the hashes saved by a previous build. A missing or damaged
+    // cache only means that everything gets hashed again.
+    void load_cache(const std::filesystem::path &cache_path);
+
+    // Saves the hashes of the assets resolved in this build. Same as with
+    // assets(), nothing may be getting resolved at the time.
+    Error save_cache(const std::filesystem::path &cache_path) const;
+
+    // Returns the URL of the fingerprinted copy of `relative_path`, which is
+    // relative to the pages directory. For css/site.css, that is something
+    // like /pages/css/site.0123456789abcdef.css.
+    std::tuple<std::string, Error> resolve(std::string_view relative_path);
+
+    // Every asset resolved so far, sorted by input. Only call it once nothing
+    // is being resolved anymore.
+    std::vector<FingerprintedAsset> assets() const;
+
+    // How many assets had to be read and hashed, rather than coming from the
+    // cache.
+    size_t hashed_count() const { return hashed.load(); }
+
+  private:
+    struct CachedHash {
+        int64_t size;
+        int64_t modification_time;
+        uint64_t hash;
+    };
+
+    struct Slot {
+        std::once_flag once;
+        CachedHash cached;
+        std::string output;
+        Error error{Error::OK};
+    };
+
+    std::filesystem::path pages_path;
+    std::unordered_map<std::string, CachedHash> previous_build;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Slot>> slots;
+    std::atomic<size_t> hashed{0};
+};
+} // namespace neng
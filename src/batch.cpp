@@ -0,0 +1,135 @@
+#include "batch.hpp"
+#include "document_template.hpp"
+#include "embedded_template.hpp"
+#include "parallel.hpp"
+#include "render_pipeline.hpp"
+#include "string_utils.hpp"
+
+namespace fs = std::filesystem;
+
+namespace neng {
+std::vector<BatchEntry>
+parse_batch_manifest(std::istream &manifest,
+                     std::vector<size_t> &invalid_lines) {
+    std::vector<BatchEntry> entries;
+
+    std::string line;
+    for (size_t line_number = 1; std::getline(manifest, line);
+         line_number++) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (trim_string(line).empty()) {
+            continue;
+        }
+
+        const auto fields = split_string(line, "\t");
+        if (fields.size() < 2 || fields.size() > 3 || fields[0].empty() ||
+            fields[1].empty()) {
+            invalid_lines.push_back(line_number);
+            continue;
+        }
+
+        entries.push_back({
+            .line_number = line_number,
+            .input = fields[0],
+            .output = fields[1],
+            .template_path = fields.size() == 3 && !fields[2].empty()
+                                 ? std::optional<fs::path>{fields[2]}
+                                 : std::nullopt,
+        });
+    }
+
+    return entries;
+}
+
+Error run_batch(std::istream &manifest,
+                const DocumentConfiguration &document_config,
+                const std::optional<fs::path> &default_template_path,
+                std::ostream &status) {
+    std::vector<size_t> invalid_lines;
+    const auto entries = parse_batch_manifest(manifest, invalid_lines);
+
+    // Every distinct template gets loaded once, up front, and then shared by
+    // all of the entries that use it.
+    struct LoadedTemplate {
+        DocumentTemplate document_template;
+        Error error;
+    };
+
+    // The template chosen by load_template goes under the empty key.
+    const auto template_key = [&](const BatchEntry &entry) {
+        const auto &template_path = entry.template_path
+                                        ? entry.template_path
+                                        : default_template_path;
+        return template_path ? template_path->string() : std::string{};
+    };
+
+    std::unordered_map<std::string, LoadedTemplate> templates;
+    for (const auto &entry : entries) {
+        const auto key = template_key(entry);
+        if (templates.contains(key)) {
+            continue;
+        }
+
+        const auto &template_path = entry.template_path
+                                        ? entry.template_path
+                                        : default_template_path;
+        auto [document_template, error] = load_template(template_path);
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to parse the template "
+                      << template_path.value_or(DEFAULT_TEMPLATE_PATH) << ": "
+                      << error << '\n';
+        }
+
+        if (document_config.minify) {
+            document_template.minify();
+        }
+
+        templates.emplace(key,
+                          LoadedTemplate{std::move(document_template), error});
+    }
+
+    std::vector<Error> results(entries.size(), Error::OK);
+
+    parallel_for(entries.size(), [&](size_t i) {
+        const auto &entry = entries[i];
+        const auto &loaded = templates.at(template_key(entry));
+        if (loaded.error != Error::OK) {
+            results[i] = loaded.error;
+            return;
+        }
+
+        results[i] = render_single_file(entry.input, entry.output,
+                                        document_config,
+                                        loaded.document_template);
+    });
+
+    // The syntax errors are merged in so that the report stays in line order.
+    auto result = invalid_lines.empty() ? Error::OK : Error::INVALID_SYNTAX;
+    auto invalid_line = invalid_lines.begin();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (; invalid_line != invalid_lines.end() &&
+               *invalid_line < entries[i].line_number;
+             invalid_line++) {
+            status << *invalid_line << '\t' << Error::INVALID_SYNTAX << "\t\n";
+        }
+
+        status << entries[i].line_number << '\t' << results[i] << '\t'
+               << entries[i].input.string() << '\n';
+        if (results[i] != Error::OK) {
+            result = results[i];
+        }
+    }
+
+    for (; invalid_line != invalid_lines.end(); invalid_line++) {
+        status << *invalid_line << '\t' << Error::INVALID_SYNTAX << "\t\n";
+    }
+
+    status.flush();
+
+    return result;
+}
+} // namespace neng
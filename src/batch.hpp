@@ -0,0 +1,36 @@
+#pragma once
+
+#include "document.hpp"
+
+#include <optional>
+
+namespace neng {
+// One line of a batch manifest:
+//
+//     <input>\t<output>[\t<template>]
+//
+// Lines without a template use the default one, which, if there is no default
+// template path either, is the one load_template picks.
+struct BatchEntry {
+    size_t line_number;
+    std::filesystem::path input;
+    std::filesystem::path output;
+    std::optional<std::filesystem::path> template_path;
+};
+
+// Reads a manifest, one entry per line. Blank lines are skipped, and lines
+// that do not fit the format come back in `invalid_lines`.
+std::vector<BatchEntry> parse_batch_manifest(std::istream &manifest,
+                                             std::vector<size_t> &invalid_lines);
+
+// Renders every entry of the manifest in parallel, loading each distinct
+// template only once. The outcome of every line is written to `status` as
+//
+//     <line number>\t<Error>\t<input>
+//
+// in manifest order. Returns Error::OK only if every line succeeded.
+Error run_batch(std::istream &manifest,
+                const DocumentConfiguration &document_config,
+                const std::optional<std::filesystem::path> &default_template_path,
+                std::ostream &status);
+} // namespace neng
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+namespace neng {
+// A fixed-capacity, lock-free multi-producer multi-consumer queue (Dmitry
+// Vyukov's design). Every cell carries a sequence number that tells producers
+// and consumers whose turn it is, so the only contention is on the two
+// positions.
+//
+// On top of the raw try_push/try_pop, the queue counts the producers that
+// are still feeding it, which lets consumers tell "empty for now" apart from
+// "empty for good".
+template <typename T> class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t rounded = 2;
+        while (rounded < capacity) {
+            rounded *= 2;
+        }
+
+        cells = std::make_unique<Cell[]>(rounded);
+        mask = rounded - 1;
+        for (size_t i = 0; i < rounded; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(T value) {
+        auto position = enqueue_position.load(std::memory_order_relaxed);
+        for (;;) {
+            auto &cell = cells[position & mask];
+            const auto sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<intptr_t>(sequence) -
+                                    static_cast<intptr_t>(position);
+
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1,
+                                        std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T &value) {
+        auto position = dequeue_position.load(std::memory_order_relaxed);
+        for (;;) {
+            auto &cell = cells[position & mask];
+            const auto sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<intptr_t>(sequence) -
+                                    static_cast<intptr_t>(position + 1);
+
+            if (difference == 0) {
+                if (dequeue_position.compare_exchange_weak(
+                        position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1,
+                                        std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void add_producer() { producers.fetch_add(1); }
+
+    void remove_producer() { producers.fetch_sub(1); }
+
+    // Spins until there is room for the value.
+    void push(T value) {
+        for (size_t attempt = 0; !try_push(value); attempt++) {
+            back_off(attempt);
+        }
+    }
+
+    // Waits for a value, returning false once the queue is empty and every
+    // producer is gone.
+    bool pop(T &value) {
+        for (size_t attempt = 0;; attempt++) {
+            if (try_pop(value)) {
+                return true;
+            }
+
+            if (producers.load() == 0) {
+                // A producer may have pushed right before leaving.
+                return try_pop(value);
+            }
+
+            back_off(attempt);
+        }
+    }
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static void back_off(size_t attempt) {
+        if (attempt < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_position{0};
+    alignas(64) std::atomic<size_t> dequeue_position{0};
+    alignas(64) std::atomic<size_t> producers{0};
+};
+} // namespace neng
@@ -0,0 +1,86 @@
+#include "build_manifest.hpp"
+#include "string_utils.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+namespace {
+bool parse_size(std::string_view string, size_t &value) {
+    const auto [end, error_code] =
+        std::from_chars(string.data(), string.data() + string.size(), value);
+    return error_code == std::errc{} && end == string.data() + string.size();
+}
+} // namespace
+
+namespace neng {
+std::tuple<BuildManifest, Error>
+BuildManifest::from_file(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return {{}, Error::FILE_OPEN_ERROR};
+    }
+
+    BuildManifest manifest;
+
+    std::string line;
+    std::getline(file, line);
+
+    constexpr std::string_view shard_prefix = "shard ";
+    const auto shard = split_string(
+        std::string_view{line}.substr(std::min(line.size(),
+                                               shard_prefix.size())),
+        "/");
+    if (!line.starts_with(shard_prefix) || shard.size() != 2 ||
+        !parse_size(shard[0], manifest.shard_index) ||
+        !parse_size(shard[1], manifest.shard_count) ||
+        manifest.shard_index == 0 ||
+        manifest.shard_index > manifest.shard_count) {
+        std::cerr << "[ERROR]: " << path << ":1: Invalid syntax\n";
+        return {{}, Error::INVALID_SYNTAX};
+    }
+    manifest.shard_index--;
+
+    uint32_t line_number = 2;
+    while (std::getline(file, line)) {
+        const auto parts = split_string(line, "\t");
+
+        ManifestPage page;
+        if (parts.size() != 3 || !parse_size(parts[2], page.size)) {
+            std::cerr << "[ERROR]: " << path << ":" << line_number
+                      << ": Invalid syntax\n";
+            return {{}, Error::INVALID_SYNTAX};
+        }
+
+        page.input = parts[0];
+        page.output = parts[1];
+        manifest.pages.push_back(std::move(page));
+        line_number++;
+    }
+
+    return {std::move(manifest), Error::OK};
+}
+
+Error BuildManifest::write_to_file(const std::filesystem::path &path) const {
+    std::vector<const ManifestPage *> sorted_pages;
+    sorted_pages.reserve(pages.size());
+    for (const auto &page : pages) {
+        sorted_pages.push_back(&page);
+    }
+
+    std::sort(sorted_pages.begin(), sorted_pages.end(),
+              [](const auto *a, const auto *b) { return a->input < b->input; });
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    file << "shard " << shard_index + 1 << '/' << shard_count << '\n';
+    for (const auto *page : sorted_pages) {
+        file << page->input << '\t' << page->output << '\t' << page->size
+             << '\n';
+    }
+
+    return file ? Error::OK : Error::FILE_WRITE_ERROR;
+}
+} // namespace neng
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "document.hpp"
+
+namespace neng {
+struct ManifestPage {
+    // The path of the page relative to the pages directory.
+    std::string input;
+    // The path of the output relative to the output directory.
+    std::string output;
+    // The size of the source, which is what sharded builds balance on.
+    size_t size;
+};
+
+// What a build rendered, kept around for the builds after it. A sharded build
+// writes one with just its own pages, and merging the shards puts them back
+// together.
+struct BuildManifest {
+    size_t shard_index{0};
+    size_t shard_count{1};
+    std::vector<ManifestPage> pages;
+
+    // The first line is "shard <index>/<count>" (counting from 1, like
+    // --shard), and every line after it is input<TAB>output<TAB>size.
+    static std::tuple<BuildManifest, Error>
+    from_file(const std::filesystem::path &path);
+
+    // Writes the pages sorted by input, so that the same build always writes
+    // the same file.
+    Error write_to_file(const std::filesystem::path &path) const;
+};
+} // namespace neng
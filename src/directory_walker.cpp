@@ -0,0 +1,242 @@
+#include "directory_walker.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+#ifdef __linux__
+// The layout the kernel fills the getdents64 buffer with. glibc only started
+// exposing a wrapper for it recently, so it is declared here instead.
+struct LinuxDirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Directories that are yet to be read, shared by all of the walking threads.
+// A thread that runs out of work waits here until either another thread
+// pushes a subdirectory or every thread is idle, which means the walk is done.
+class DirectoryQueue {
+  public:
+    explicit DirectoryQueue(std::string root) {
+        directories.push_back(std::move(root));
+    }
+
+    void push(std::string directory) {
+        {
+            std::lock_guard lock{mutex};
+            directories.push_back(std::move(directory));
+        }
+        condition.notify_one();
+    }
+
+    // Returns false once there is nothing left to walk.
+    bool pop(std::string &directory) {
+        std::unique_lock lock{mutex};
+        busy_threads--;
+        if (directories.empty() && busy_threads == 0) {
+            condition.notify_all();
+            return false;
+        }
+
+        condition.wait(lock, [this]() {
+            return !directories.empty() || busy_threads == 0;
+        });
+        if (directories.empty()) {
+            return false;
+        }
+
+        directory = std::move(directories.back());
+        directories.pop_back();
+        busy_threads++;
+        return true;
+    }
+
+    void start_thread() {
+        std::lock_guard lock{mutex};
+        busy_threads++;
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::string> directories;
+    size_t busy_threads{0};
+};
+
+bool is_dot_entry(const char *name) {
+    return name[0] == '.' &&
+           (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// Reads a single directory, queueing its subdirectories and collecting the
+// files that pass the filter. `relative_directory` is either empty or ends
+// with a '/'.
+neng::Error read_directory(int root_fd, const std::string &relative_directory,
+                           const neng::FileFilter &filter,
+                           DirectoryQueue &queue,
+                           std::vector<std::string> &files) {
+    const int directory_fd =
+        relative_directory.empty()
+            ? dup(root_fd)
+            : openat(root_fd, relative_directory.c_str(),
+                     O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0) {
+        return neng::Error::FILE_OPEN_ERROR;
+    }
+
+    alignas(LinuxDirent64) char buffer[64 * 1024];
+
+    for (;;) {
+        const auto bytes_read =
+            syscall(SYS_getdents64, directory_fd, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            close(directory_fd);
+            return neng::Error::FILE_READ_ERROR;
+        }
+
+        if (bytes_read == 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < bytes_read;) {
+            const auto *entry =
+                reinterpret_cast<const LinuxDirent64 *>(buffer + offset);
+            offset += entry->d_reclen;
+
+            if (is_dot_entry(entry->d_name)) {
+                continue;
+            }
+
+            auto type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // Symbolic links count as whatever they point to, except that
+                // linked directories are not descended into, just like
+                // std::filesystem::recursive_directory_iterator.
+                struct stat file_stat;
+                const int flags = type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW;
+                if (fstatat(directory_fd, entry->d_name, &file_stat, flags) !=
+                    0) {
+                    continue;
+                }
+
+                if (S_ISREG(file_stat.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(file_stat.st_mode) && type != DT_LNK) {
+                    type = DT_DIR;
+                }
+            }
+
+            if (type == DT_DIR) {
+                queue.push(relative_directory + entry->d_name + '/');
+            } else if (type == DT_REG && filter(entry->d_name)) {
+                files.push_back(relative_directory + entry->d_name);
+            }
+        }
+    }
+
+    close(directory_fd);
+    return neng::Error::OK;
+}
+#endif
+} // namespace
+
+namespace neng {
+#ifdef __linux__
+std::tuple<std::vector<std::string>, Error>
+walk_directory(const fs::path &root, const FileFilter &filter) {
+    const int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        return {{}, Error::FILE_OPEN_ERROR};
+    }
+
+    DirectoryQueue queue{""};
+
+    const auto thread_count = worker_count();
+    std::vector<std::vector<std::string>> thread_files(thread_count);
+    std::vector<Error> thread_errors(thread_count, Error::OK);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        queue.start_thread();
+    }
+
+    parallel_for(
+        thread_count,
+        [&](size_t thread_index) {
+            std::string directory;
+            while (queue.pop(directory)) {
+                const auto error = read_directory(root_fd, directory, filter,
+                                                  queue,
+                                                  thread_files[thread_index]);
+                if (error != Error::OK) {
+                    std::cerr << "[ERROR]: Failed to read the directory "
+                              << root / directory << ": " << error << '\n';
+                    thread_errors[thread_index] = error;
+                }
+            }
+        },
+        thread_count);
+
+    close(root_fd);
+
+    for (const auto error : thread_errors) {
+        if (error != Error::OK) {
+            return {{}, error};
+        }
+    }
+
+    std::vector<std::string> files;
+    for (auto &batch : thread_files) {
+        files.insert(files.end(), std::make_move_iterator(batch.begin()),
+                     std::make_move_iterator(batch.end()));
+    }
+
+    std::sort(files.begin(), files.end());
+
+    return {std::move(files), Error::OK};
+}
+#else
+std::tuple<std::vector<std::string>, Error>
+walk_directory(const fs::path &root, const FileFilter &filter) {
+    std::error_code error_code;
+    fs::recursive_directory_iterator iterator{root, error_code};
+    if (error_code) {
+        return {{}, Error::FILE_OPEN_ERROR};
+    }
+
+    std::vector<std::string> files;
+    for (const auto &file : iterator) {
+        if (file.is_regular_file() &&
+            filter(file.path().filename().string())) {
+            files.push_back(
+                file.path().lexically_relative(root).generic_string());
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+
+    return {std::move(files), Error::OK};
+}
+#endif
+
+FileFilter has_extension(std::string_view extension) {
+    return [extension = std::string(extension)](std::string_view file_name) {
+        return file_name.size() > extension.size() &&
+               file_name.ends_with(extension);
+    };
+}
+} // namespace neng
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "document.hpp"
+
+#include <functional>
+
+namespace neng {
+// Decides from a file name alone whether a file should be collected.
+using FileFilter = std::function<bool(std::string_view file_name)>;
+
+// Recursively lists the regular files under `root` that pass `filter`. The
+// paths are relative to `root`, use '/' as the separator, and are sorted so
+// that the result does not depend on the order the subtrees were walked in.
+//
+// On Linux, this reads the directories with openat and getdents64 and walks
+// separate subtrees on separate threads.
+std::tuple<std::vector<std::string>, Error>
+walk_directory(const std::filesystem::path &root, const FileFilter &filter);
+
+// Matches file names ending with `extension`, such as ".md".
+FileFilter has_extension(std::string_view extension);
+} // namespace neng
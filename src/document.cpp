@@ -1,5 +1,9 @@
 #include "document.hpp"
 
+#include "flat_document.hpp"
+#include "fragment_cache.hpp"
+#include "html_minifier.hpp"
+#include "input_normalizer.hpp"
 #include "string_utils.hpp"
 #include <fstream>
 
@@ -30,6 +34,15 @@ std::ostream &operator<<(std::ostream &os, Error error) {
     case Error::FILE_DOES_NOT_EXIST:
         os << "FILE_DOES_NOT_EXIST";
         break;
+    case Error::FILE_WRITE_ERROR:
+        os << "FILE_WRITE_ERROR";
+        break;
+    case Error::INVALID_UTF8:
+        os << "INVALID_UTF8";
+        break;
+    case Error::FILE_TOO_LARGE:
+        os << "FILE_TOO_LARGE";
+        break;
     }
 
     return os;
@@ -49,23 +62,10 @@ std::ostream &operator<<(std::ostream &os, ParagraphType paragraph_type) {
 }
 
 bool is_line_title(std::string_view line) {
-    if (!line.starts_with('#')) {
-        return false;
-    }
-
-    char previous_char = 0;
-    for (auto character : line) {
-        if (character != '#') {
-            if (character == ' ') {
-                return true;
-            } else {
-                return false;
-            }
-        }
-        previous_char = character;
-    }
-
-    return false;
+    // Unlike lex_line, this takes the line as it is, without trimming it.
+    const auto hashes_end = line.find_first_not_of('#');
+    return hashes_end != 0 && hashes_end != std::string_view::npos &&
+           line[hashes_end] == ' ';
 }
 
 uint8_t count_title_level(std::string_view line) {
@@ -73,39 +73,57 @@ uint8_t count_title_level(std::string_view line) {
         return 0;
     }
 
-    int level = 0;
-    for (auto character : line) {
-        if (character != '#') {
-            break;
-        }
-
-        level += 1;
-    }
-
-    return level;
+    return static_cast<uint8_t>(line.find_first_not_of('#'));
 }
 
-std::string Paragraph::render_to_html(std::string_view paragraph_class,
-                                      std::string_view title_class) const {
-    std::string opener;
-    std::string closer;
+void append_paragraph_html(ParagraphType type, uint8_t header_level,
+                           std::string_view content,
+                           std::string_view paragraph_class,
+                           std::string_view title_class, bool minify,
+                           std::string &out) {
     switch (type) {
     case ParagraphType::NORMAL:
-        opener = "<p class=\""s + std::string(paragraph_class) + "\">"s;
-        closer = "</p>";
+        out += "<p class=\"";
+        out += paragraph_class;
+        out += "\">";
         break;
     case ParagraphType::HEADER:
-        opener = "<h"s + std::to_string(header_level);
+        out += "<h";
+        out += std::to_string(header_level);
         if (header_level == 1) {
-            opener += " class=\"" + std::string(title_class) + "\"";
+            out += " class=\"";
+            out += title_class;
+            out += '"';
         }
-        opener += '>';
-        closer = "</h"s + std::to_string(header_level) + ">";
+        out += '>';
         break;
     }
 
-    std::string result = opener + content + closer;
+    if (minify) {
+        MinifyState state;
+        minify_html(content, out, state);
+    } else {
+        out += content;
+    }
+
+    switch (type) {
+    case ParagraphType::NORMAL:
+        out += "</p>";
+        break;
+    case ParagraphType::HEADER:
+        out += "</h";
+        out += std::to_string(header_level);
+        out += '>';
+        break;
+    }
+}
 
+std::string Paragraph::render_to_html(std::string_view paragraph_class,
+                                      std::string_view title_class,
+                                      bool minify) const {
+    std::string result;
+    append_paragraph_html(type, header_level, content, paragraph_class,
+                          title_class, minify, result);
     return result;
 }
 
@@ -119,6 +137,7 @@ DocumentConfiguration::from_file(std::string_view file_path) {
 
     std::string title_class;
     std::string paragraph_class;
+    bool minify = false;
 
     uint32_t line_number = 1;
     while (!file.eof()) {
@@ -142,6 +161,8 @@ DocumentConfiguration::from_file(std::string_view file_path) {
             title_class = statement_parts.at(1);
         } else if (statement_parts.at(0) == "paragraph_class") {
             paragraph_class = statement_parts.at(1);
+        } else if (statement_parts.at(0) == "minify") {
+            minify = statement_parts.at(1) == "true";
         } else {
             std::cerr << "[ERROR]: " << file_path << ":" << line_number
                       << ": Unknown key '" << statement_parts.at(0) << "'\n";
@@ -154,97 +175,24 @@ DocumentConfiguration::from_file(std::string_view file_path) {
         DocumentConfiguration{
             .title_class = title_class,
             .paragraph_class = paragraph_class,
+            .minify = minify,
         },
         Error::OK,
     };
 }
 
-void Document::parse_document_line(std::string_view line,
-                                   std::string &current_paragraph,
-                                   std::vector<Paragraph> &paragraphs) {
-    bool line_blank = true;
-    for (auto character : line) {
-        if (!std::isspace(character)) {
-            line_blank = false;
-            break;
-        }
-    }
-
-    if (line_blank) {
-        if (current_paragraph != "") {
-            paragraphs.push_back(Paragraph{
-                .type = ParagraphType::NORMAL,
-                .content = trim_string(current_paragraph),
-            });
-        }
-        current_paragraph = "";
-        return;
-    }
-
-    const auto trimmed_line = trim_string(line);
-    const auto header_level = count_title_level(trimmed_line);
-    if (header_level > 0) {
-        if (current_paragraph != "") {
-            paragraphs.push_back(Paragraph{
-                .type = ParagraphType::NORMAL,
-                .content = trim_string(current_paragraph),
-            });
-        }
-        current_paragraph = trimmed_line;
-        paragraphs.push_back(Paragraph{
-            .type = ParagraphType::HEADER,
-            .content = trim_string(current_paragraph.substr(
-                current_paragraph.find_first_of(' ') + 1)),
-            .header_level = header_level,
-        });
-        current_paragraph = "";
-        return;
-    }
-
-    current_paragraph += trim_string(line) + " ";
-}
-
 Document Document::parse_document(std::string_view document) {
-    std::vector<Paragraph> paragraphs;
-    std::string current_paragraph;
-
-    const auto lines = split_string(document, "\n");
-
-    for (const auto &line : lines) {
-        parse_document_line(line, current_paragraph, paragraphs);
-    }
-
-    paragraphs.push_back(Paragraph{
-        .type = ParagraphType::NORMAL,
-        .content = trim_string(current_paragraph),
-    });
-
-    return Document{.paragraphs = paragraphs};
+    return FlatDocument::parse(document).to_document();
 }
 
 std::tuple<Document, Error>
-Document::parse_document_from_file(const std::filesystem::path& file_path) {
-    std::ifstream file(file_path);
-    if (!file.is_open()) {
-        return {{}, Error::FILE_OPEN_ERROR};
-    }
-
-    std::vector<Paragraph> paragraphs;
-    std::string current_paragraph;
-
-    while (!file.eof()) {
-        std::string line;
-        std::getline(file, line);
-
-        parse_document_line(line, current_paragraph, paragraphs);
+Document::parse_document_from_file(const std::filesystem::path &file_path) {
+    const auto [source, error] = read_input(file_path);
+    if (error != Error::OK) {
+        return {{}, error};
     }
 
-    paragraphs.push_back(Paragraph{
-        .type = ParagraphType::NORMAL,
-        .content = trim_string(current_paragraph),
-    });
-
-    return {{paragraphs}, Error::OK};
+    return {parse_document(source), Error::OK};
 }
 
 std::string Document::get_title() const {
@@ -257,12 +205,46 @@ std::string Document::get_title() const {
     return "";
 }
 
+uint64_t DocumentConfiguration::fragment_hash() const {
+    return fragment_cache && minify ? FragmentCache::hash_configuration(*this)
+                                    : 0;
+}
+
+void DocumentConfiguration::render_paragraph(ParagraphType type,
+                                             uint8_t header_level,
+                                             std::string_view content,
+                                             uint64_t fragment_hash,
+                                             std::string &out) const {
+    // Without minifying, rendering is a copy of the content, which is quicker
+    // than hashing it and looking it up.
+    if (!fragment_cache || !minify) {
+        append_paragraph_html(type, header_level, content, paragraph_class,
+                              title_class, minify, out);
+        return;
+    }
+
+    const auto hash = FragmentCache::hash_paragraph(fragment_hash, type,
+                                                    header_level, content);
+    if (fragment_cache->append_cached(hash, type, header_level, content,
+                                      out)) {
+        return;
+    }
+
+    const auto fragment_begin = out.size();
+    append_paragraph_html(type, header_level, content, paragraph_class,
+                          title_class, minify, out);
+    fragment_cache->insert(hash, type, header_level, content,
+                           std::string_view{out}.substr(fragment_begin));
+}
+
 std::string
 DocumentConfiguration::render_html_to_string(const Document &document) const {
     std::string result;
 
+    const auto hash = fragment_hash();
     for (const auto &paragraph : document.paragraphs) {
-        result.append(paragraph.render_to_html(paragraph_class, title_class));
+        render_paragraph(paragraph.type, paragraph.header_level,
+                         paragraph.content, hash, result);
     }
 
     return result;
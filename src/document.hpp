@@ -1,5 +1,7 @@
 #pragma once
 
+#include "parallel.hpp"
+
 namespace neng {
 // TODO: Move this to somewhere more appropriate
 enum class Error {
@@ -10,6 +12,9 @@ enum class Error {
     INVALID_SYNTAX = 4,
     NO_PAGES_DIRECTORY = 5,
     FILE_DOES_NOT_EXIST = 6,
+    FILE_WRITE_ERROR = 7,
+    INVALID_UTF8 = 8,
+    FILE_TOO_LARGE = 9,
 };
 
 std::ostream &operator<<(std::ostream &os, Error error);
@@ -19,26 +24,40 @@ bool is_line_title(std::string_view line);
 // The assumption is that the line is trimmed (so no leading whitespace).
 uint8_t count_title_level(std::string_view line);
 
+// Documents smaller than this are not worth splitting between threads.
+constexpr size_t PARALLEL_CHUNK_SIZE = 1 << 20;
+
+// Sources this big or bigger are refused with Error::FILE_TOO_LARGE, since a
+// FlatDocument keeps 32-bit offsets into its text.
+constexpr size_t MAX_SOURCE_SIZE = size_t{1} << 32;
+
 enum class ParagraphType { NORMAL, HEADER };
 
 std::ostream &operator<<(std::ostream &os, ParagraphType paragraph_type);
 
+// Appends the HTML of a paragraph to `out`. Every renderer goes through this.
+// With `minify`, the whitespace in the content is collapsed on its way into
+// the HTML.
+void append_paragraph_html(ParagraphType type, uint8_t header_level,
+                           std::string_view content,
+                           std::string_view paragraph_class,
+                           std::string_view title_class, bool minify,
+                           std::string &out);
+
 struct Paragraph {
     ParagraphType type;
     std::string content;
     uint8_t header_level{0};
 
     std::string render_to_html(std::string_view paragraph_class,
-                               std::string_view title_class) const;
+                               std::string_view title_class,
+                               bool minify = false) const;
 };
 
 struct Document {
     std::vector<Paragraph> paragraphs;
 
-    static void parse_document_line(std::string_view line,
-                                    std::string &current_paragraph,
-                                    std::vector<Paragraph> &paragraphs);
-
+    // Goes through FlatDocument::parse, which every parser shares.
     static Document parse_document(std::string_view content);
 
     static std::tuple<Document, Error>
@@ -47,14 +66,45 @@ struct Document {
     std::string get_title() const;
 };
 
+struct FlatDocument;
+class FragmentCache;
+
 struct DocumentConfiguration {
     std::string title_class;
     std::string paragraph_class;
+    // Collapses the whitespace in the rendered paragraphs. Set with
+    // minify=true, or with --minify.
+    bool minify{false};
+    // Where rendered paragraphs are shared between pages, if anywhere. Not
+    // owned.
+    FragmentCache *fragment_cache{nullptr};
 
     static std::tuple<DocumentConfiguration, Error>
     from_file(std::string_view file_path);
 
+    // What sets this configuration's paragraphs apart from another's in the
+    // fragment cache, or 0 when the cache is not used. Worked out once per
+    // document.
+    uint64_t fragment_hash() const;
+
+    // Renders a paragraph onto the end of `out`, going through the fragment
+    // cache when there is one and `minify` is set. Every document renderer
+    // goes through this.
+    void render_paragraph(ParagraphType type, uint8_t header_level,
+                          std::string_view content, uint64_t fragment_hash,
+                          std::string &out) const;
+
     std::string render_html_to_string(const Document &document) const;
+
+    // Defined in flat_document.cpp.
+    std::string render_html_to_string(const FlatDocument &document) const;
+
+    // Renders runs of paragraphs of about `chunk_size` bytes each into their
+    // own buffers on up to `thread_count` threads, and joins them in order.
+    std::string
+    render_html_to_string_parallel(const FlatDocument &document,
+                                   size_t thread_count = worker_count(),
+                                   size_t chunk_size = PARALLEL_CHUNK_SIZE) const;
 };
 
 struct BasicDocumentTemplate {
@@ -1,18 +1,30 @@
 #include "document_template.hpp"
+#include "asset_fingerprints.hpp"
+#include "html_minifier.hpp"
 #include "string_utils.hpp"
 
 namespace {
 using neng::TemplateSegment;
 
 TemplateSegment parse_expression(std::string_view expression) {
-    // For now, this only parses out variables, though in the future it might
+    // This parses out variables and assets, though in the future it might
     // extend to something more.
 
     // No validations are done so far, though that can be added later.
 
+    const auto trimmed = neng::trim_string(expression);
+
+    constexpr std::string_view asset_keyword = "asset ";
+    if (trimmed.starts_with(asset_keyword)) {
+        return {
+            .type = TemplateSegment::Type::ASSET,
+            .a = neng::trim_string(trimmed.substr(asset_keyword.size())),
+        };
+    }
+
     return {
         .type = TemplateSegment::Type::VARIABLE,
-        .a = neng::trim_string(expression),
+        .a = trimmed,
     };
 }
 } // namespace
@@ -26,6 +38,9 @@ std::ostream &operator<<(std::ostream &stream, TemplateSegment::Type type) {
         case TemplateSegment::Type::TEXT:
             stream << "TemplateSegment::Type::TEXT";
             break;
+        case TemplateSegment::Type::ASSET:
+            stream << "TemplateSegment::Type::ASSET";
+            break;
     }
 
     return stream;
@@ -105,6 +120,53 @@ DocumentTemplate::from_file(const std::filesystem::path &path) {
     return from_string(source);
 }
 
+DocumentTemplate
+DocumentTemplate::from_embedded(std::span<const EmbeddedSegment> segments) {
+    DocumentTemplate document_template;
+    document_template.segments.reserve(segments.size());
+
+    for (const auto &segment : segments) {
+        document_template.segments.push_back({
+            .type = segment.type,
+            .a = std::string(segment.a),
+        });
+    }
+
+    return document_template;
+}
+
+void DocumentTemplate::minify() {
+    // The text segments are pieces of one HTML file, so a <pre> opened in one
+    // of them is still open in the next.
+    MinifyState state;
+    for (auto &segment : segments) {
+        if (segment.type != TemplateSegment::Type::TEXT) {
+            continue;
+        }
+
+        std::string minified;
+        minify_html(segment.a, minified, state);
+        segment.a = std::move(minified);
+    }
+}
+
+Error DocumentTemplate::resolve_assets(AssetFingerprints &fingerprints) {
+    for (auto &segment : segments) {
+        if (segment.type != TemplateSegment::Type::ASSET) {
+            continue;
+        }
+
+        auto [url, error] = fingerprints.resolve(segment.a);
+        if (error != Error::OK) {
+            return error;
+        }
+
+        segment.a = std::move(url);
+    }
+
+    return Error::OK;
+}
+
 std::string DocumentTemplate::render_to_string(std::string_view title,
                                                std::string_view body) const {
     std::string acc;
@@ -112,6 +174,7 @@ std::string DocumentTemplate::render_to_string(std::string_view title,
     for (const auto &segment : segments) {
         switch (segment.type) {
         case TemplateSegment::Type::TEXT:
+        case TemplateSegment::Type::ASSET:
             acc += segment.a;
             break;
         case TemplateSegment::Type::VARIABLE:
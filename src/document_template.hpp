@@ -2,11 +2,20 @@
 
 #include "document.hpp"
 
+#include <span>
+
+namespace neng {
+class AssetFingerprints;
+}
+
 namespace neng {
 struct TemplateSegment {
     enum class Type {
         VARIABLE,
         TEXT,
+        // ${{asset path}}. Holds the path until resolve_assets swaps it for
+        // the fingerprinted URL.
+        ASSET,
     };
 
     Type type;
@@ -16,6 +25,14 @@ struct TemplateSegment {
 
 std::ostream& operator<<(std::ostream& stream, TemplateSegment::Type type);
 
+// A segment of a template that was compiled into the binary, pointing into
+// read-only data. See embedded_template.hpp.
+struct EmbeddedSegment {
+    TemplateSegment::Type type;
+
+    std::string_view a;
+};
+
 struct DocumentTemplate {
     std::vector<TemplateSegment> segments;
 
@@ -25,6 +42,19 @@ struct DocumentTemplate {
     static std::tuple<DocumentTemplate, Error>
     from_file(const std::filesystem::path& path);
 
+    // Takes segments that were split up when the binary was built, so there
+    // is nothing to read or parse.
+    static DocumentTemplate
+    from_embedded(std::span<const EmbeddedSegment> segments);
+
+    // Collapses the whitespace in the template's own text, once, so that
+    // every page rendered with it comes out smaller. See minify_html.
+    void minify();
+
+    // Fingerprints the assets that the template refers to, and points the
+    // template at the fingerprinted copies.
+    Error resolve_assets(AssetFingerprints &fingerprints);
+
     std::string render_to_string(std::string_view title,
                                  std::string_view body) const;
 };
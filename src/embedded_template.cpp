@@ -0,0 +1,14 @@
+#include "embedded_template.hpp"
+
+namespace neng {
+std::tuple<DocumentTemplate, Error>
+load_template(const std::optional<std::filesystem::path> &path) {
+#ifdef PROCESSOR_EMBEDDED_TEMPLATE
+    if (!path) {
+        return {DocumentTemplate::from_embedded(EMBEDDED_TEMPLATE), Error::OK};
+    }
+#endif
+
+    return DocumentTemplate::from_file(path.value_or(DEFAULT_TEMPLATE_PATH));
+}
+} // namespace neng
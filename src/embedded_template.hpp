@@ -0,0 +1,34 @@
+#pragma once
+
+#include "document_template.hpp"
+
+#include <optional>
+
+namespace neng {
+// Configuring with -DPROCESSOR_EMBED_TEMPLATE=<template.html> runs the
+// template through template_embedder while building, which splits it into
+// segments and writes them out as a constexpr table in a generated source
+// file. That table is linked in as EMBEDDED_TEMPLATE and used whenever no
+// template is given with -t, so rendering never has to read or parse one.
+#ifdef PROCESSOR_EMBEDDED_TEMPLATE
+extern const std::span<const EmbeddedSegment> EMBEDDED_TEMPLATE;
+#endif
+
+#ifdef PROCESSOR_BUILD_TESTS
+// tests/embedded.html, embedded the same way for the tests.
+extern const std::span<const EmbeddedSegment> TEST_EMBEDDED_TEMPLATE;
+#endif
+
+#ifdef PROCESSOR_EMBEDDED_TEMPLATE
+constexpr bool HAS_EMBEDDED_TEMPLATE = true;
+#else
+constexpr bool HAS_EMBEDDED_TEMPLATE = false;
+#endif
+
+inline const std::filesystem::path DEFAULT_TEMPLATE_PATH{"./template.html"};
+
+// Loads the template at `path`, or, without one, the embedded template if
+// there is one and DEFAULT_TEMPLATE_PATH if there is not.
+std::tuple<DocumentTemplate, Error>
+load_template(const std::optional<std::filesystem::path> &path);
+} // namespace neng
@@ -0,0 +1,387 @@
+#include "flat_document.hpp"
+#include "lexer.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+using neng::Error;
+using neng::FlatDocument;
+using neng::ParagraphType;
+
+// Bumped whenever the layout below changes. The arrays are written in the
+// machine's own byte order, so files are only meant to be read back on the
+// machine that wrote them.
+constexpr std::string_view FLAT_DOCUMENT_MAGIC = "NENGFLT1";
+
+struct FlatDocumentHeader {
+    char magic[8];
+    uint32_t paragraph_count;
+    uint32_t text_size;
+};
+
+// The u8 arrays are padded so that the u32 arrays after them are aligned.
+size_t aligned_to_4(size_t size) { return (size + 3) & ~size_t{3}; }
+
+void push_paragraph(FlatDocument &document, ParagraphType type,
+                    uint8_t header_level, size_t offset) {
+    document.types.push_back(type);
+    document.header_levels.push_back(header_level);
+    document.offsets.push_back(static_cast<uint32_t>(offset));
+    document.lengths.push_back(
+        static_cast<uint32_t>(document.text.size() - offset));
+}
+
+// Renders paragraphs [begin, end) onto the end of `result`.
+void render_paragraphs(const FlatDocument &document, size_t begin, size_t end,
+                       const neng::DocumentConfiguration &config,
+                       uint64_t fragment_hash, std::string &result) {
+    for (size_t i = begin; i < end; i++) {
+        config.render_paragraph(document.types[i], document.header_levels[i],
+                                document.content(i), fragment_hash, result);
+    }
+}
+
+template <typename T>
+void append_array(std::string &bytes, const std::vector<T> &array) {
+    bytes.append(reinterpret_cast<const char *>(array.data()),
+                 array.size() * sizeof(T));
+}
+
+template <typename T>
+bool read_array(std::string_view &bytes, std::vector<T> &array, size_t count) {
+    if (bytes.size() < count * sizeof(T)) {
+        return false;
+    }
+
+    array.resize(count);
+    std::memcpy(array.data(), bytes.data(), count * sizeof(T));
+    bytes.remove_prefix(count * sizeof(T));
+    return true;
+}
+} // namespace
+
+namespace neng {
+FlatDocument FlatDocument::parse(std::string_view source) {
+    FlatDocument document;
+    document.text.reserve(source.size());
+
+    // The paragraph being put together always sits at the end of the text
+    // buffer, starting at `pending_offset`.
+    size_t pending_offset = 0;
+
+    const auto flush_pending = [&]() {
+        if (document.text.size() == pending_offset) {
+            return;
+        }
+
+        document.text.pop_back();
+        push_paragraph(document, ParagraphType::NORMAL, 0, pending_offset);
+        pending_offset = document.text.size();
+    };
+
+    size_t line_begin = 0;
+    for (;;) {
+        const auto line_end = source.find('\n', line_begin);
+        const auto line = source.substr(line_begin, line_end - line_begin);
+        const auto token = lex_line(line);
+        const auto content = line.substr(
+            token.content_begin, token.content_end - token.content_begin);
+
+        if (token.kind == LineKind::TEXT) {
+            document.text.append(content);
+            document.text.push_back(' ');
+        } else {
+            flush_pending();
+
+            if (token.kind == LineKind::HEADING) {
+                document.text.append(content);
+                push_paragraph(document, ParagraphType::HEADER,
+                               token.header_level, pending_offset);
+                pending_offset = document.text.size();
+            }
+        }
+
+        if (line_end == std::string_view::npos) {
+            break;
+        }
+        line_begin = line_end + 1;
+    }
+
+    // Always end with a normal paragraph, even an empty one.
+    if (document.text.size() != pending_offset) {
+        document.text.pop_back();
+    }
+    push_paragraph(document, ParagraphType::NORMAL, 0, pending_offset);
+
+    return document;
+}
+
+FlatDocument FlatDocument::parse_parallel(std::string_view source,
+                                          size_t thread_count,
+                                          size_t chunk_size) {
+    const auto chunks = split_at_blank_lines(source, chunk_size);
+    if (chunks.size() == 1) {
+        return parse(source);
+    }
+
+    std::vector<FlatDocument> parts(chunks.size());
+    parallel_for(
+        chunks.size(),
+        [&](size_t i) { parts[i] = parse(chunks[i]); }, thread_count);
+
+    // Every chunk but the last ends on a blank line, so the paragraph that
+    // parse ends it with is an empty stand-in and gets left out.
+    FlatDocument document;
+    size_t paragraph_count = 0;
+    size_t text_size = 0;
+    for (const auto &part : parts) {
+        paragraph_count += part.size();
+        text_size += part.text.size();
+    }
+
+    document.types.reserve(paragraph_count);
+    document.header_levels.reserve(paragraph_count);
+    document.offsets.reserve(paragraph_count);
+    document.lengths.reserve(paragraph_count);
+    document.text.reserve(text_size);
+
+    for (size_t part_index = 0; part_index < parts.size(); part_index++) {
+        const auto &part = parts[part_index];
+        const auto count =
+            part_index + 1 < parts.size() ? part.size() - 1 : part.size();
+        const auto base = static_cast<uint32_t>(document.text.size());
+
+        document.types.insert(document.types.end(), part.types.begin(),
+                              part.types.begin() + count);
+        document.header_levels.insert(document.header_levels.end(),
+                                      part.header_levels.begin(),
+                                      part.header_levels.begin() + count);
+        document.lengths.insert(document.lengths.end(), part.lengths.begin(),
+                                part.lengths.begin() + count);
+        for (size_t i = 0; i < count; i++) {
+            document.offsets.push_back(base + part.offsets[i]);
+        }
+        document.text += part.text;
+    }
+
+    return document;
+}
+
+FlatDocument FlatDocument::from_document(const Document &document) {
+    FlatDocument flat;
+    for (const auto &paragraph : document.paragraphs) {
+        const auto offset = flat.text.size();
+        flat.text += paragraph.content;
+        push_paragraph(flat, paragraph.type, paragraph.header_level, offset);
+    }
+
+    return flat;
+}
+
+Document FlatDocument::to_document() const {
+    Document document;
+    document.paragraphs.reserve(size());
+    for (size_t i = 0; i < size(); i++) {
+        document.paragraphs.push_back(Paragraph{
+            .type = types[i],
+            .content = std::string(content(i)),
+            .header_level = header_levels[i],
+        });
+    }
+
+    return document;
+}
+
+std::string FlatDocument::get_title() const {
+    for (size_t i = 0; i < size(); i++) {
+        if (types[i] == ParagraphType::HEADER) {
+            return std::string(content(i));
+        }
+    }
+
+    return "";
+}
+
+std::string FlatDocument::serialize() const {
+    FlatDocumentHeader header{
+        .magic = {},
+        .paragraph_count = static_cast<uint32_t>(size()),
+        .text_size = static_cast<uint32_t>(text.size()),
+    };
+    std::memcpy(header.magic, FLAT_DOCUMENT_MAGIC.data(), sizeof(header.magic));
+
+    std::vector<uint8_t> type_bytes(size());
+    for (size_t i = 0; i < size(); i++) {
+        type_bytes[i] = static_cast<uint8_t>(types[i]);
+    }
+
+    std::string bytes;
+    bytes.reserve(sizeof(header) + aligned_to_4(size() * 2) +
+                  size() * 2 * sizeof(uint32_t) + text.size());
+
+    bytes.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    append_array(bytes, type_bytes);
+    append_array(bytes, header_levels);
+    bytes.resize(aligned_to_4(bytes.size()), '\0');
+    append_array(bytes, offsets);
+    append_array(bytes, lengths);
+    bytes += text;
+
+    return bytes;
+}
+
+std::tuple<FlatDocument, Error>
+FlatDocument::deserialize(std::string_view bytes) {
+    FlatDocumentHeader header;
+    if (bytes.size() < sizeof(header)) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::string_view{header.magic, sizeof(header.magic)} !=
+        FLAT_DOCUMENT_MAGIC) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+    bytes.remove_prefix(sizeof(header));
+
+    const size_t count = header.paragraph_count;
+    FlatDocument document;
+
+    std::vector<uint8_t> type_bytes;
+    if (!read_array(bytes, type_bytes, count) ||
+        !read_array(bytes, document.header_levels, count)) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+
+    const auto padding = aligned_to_4(count * 2) - count * 2;
+    if (bytes.size() < padding) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+    bytes.remove_prefix(padding);
+
+    if (!read_array(bytes, document.offsets, count) ||
+        !read_array(bytes, document.lengths, count) ||
+        bytes.size() != header.text_size) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+    document.text = bytes;
+
+    document.types.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (type_bytes[i] > static_cast<uint8_t>(ParagraphType::HEADER) ||
+            size_t{document.offsets[i]} + document.lengths[i] >
+                document.text.size()) {
+            return {{}, Error::INVALID_SYNTAX};
+        }
+        document.types.push_back(static_cast<ParagraphType>(type_bytes[i]));
+    }
+
+    return {std::move(document), Error::OK};
+}
+
+Error FlatDocument::write_to_file(const std::filesystem::path &path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    const auto bytes = serialize();
+    if (!file.write(bytes.data(), bytes.size())) {
+        return Error::FILE_WRITE_ERROR;
+    }
+
+    return Error::OK;
+}
+
+std::tuple<FlatDocument, Error>
+FlatDocument::from_file(const std::filesystem::path &path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {{}, Error::FILE_OPEN_ERROR};
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        return {{}, Error::FILE_READ_ERROR};
+    }
+
+    const auto size = static_cast<size_t>(status.st_size);
+    if (size == 0) {
+        close(fd);
+        return {{}, Error::INVALID_SYNTAX};
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return {{}, Error::FILE_READ_ERROR};
+    }
+
+    auto result =
+        deserialize(std::string_view{static_cast<const char *>(mapping), size});
+    munmap(mapping, size);
+
+    return result;
+}
+
+std::string
+DocumentConfiguration::render_html_to_string(const FlatDocument &document) const {
+    // The text plus the tags around each paragraph, give or take the digits.
+    std::string result;
+    result.reserve(document.text.size() +
+                   document.size() * (paragraph_class.size() + 16));
+
+    render_paragraphs(document, 0, document.size(), *this, fragment_hash(),
+                      result);
+
+    return result;
+}
+
+std::string DocumentConfiguration::render_html_to_string_parallel(
+    const FlatDocument &document, size_t thread_count,
+    size_t chunk_size) const {
+    // The paragraphs sit in the text buffer in order, so runs of about
+    // `chunk_size` bytes of it can be found straight from the offsets.
+    std::vector<size_t> run_begins{0};
+    for (size_t i = 1; i < document.size(); i++) {
+        if (document.offsets[i] - document.offsets[run_begins.back()] >=
+            chunk_size) {
+            run_begins.push_back(i);
+        }
+    }
+
+    if (run_begins.size() == 1) {
+        return render_html_to_string(document);
+    }
+    run_begins.push_back(document.size());
+
+    const auto hash = fragment_hash();
+
+    std::vector<std::string> runs(run_begins.size() - 1);
+    parallel_for(
+        runs.size(),
+        [&](size_t run) {
+            render_paragraphs(document, run_begins[run], run_begins[run + 1],
+                              *this, hash, runs[run]);
+        },
+        thread_count);
+
+    size_t total_size = 0;
+    for (const auto &run : runs) {
+        total_size += run.size();
+    }
+
+    std::string result;
+    result.reserve(total_size);
+    for (const auto &run : runs) {
+        result += run;
+    }
+
+    return result;
+}
+} // namespace neng
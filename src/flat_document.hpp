@@ -0,0 +1,55 @@
+#pragma once
+
+#include "document.hpp"
+
+namespace neng {
+// The same thing as a Document, laid out as parallel arrays with all of the
+// paragraph text in one buffer. Paragraph i is types[i] and header_levels[i],
+// with its content at text.substr(offsets[i], lengths[i]). Walking it touches
+// memory strictly in order, and it has no pointers in it, so it can be
+// written to disk as is.
+//
+// The offsets and lengths are 32 bits, so sources have to be smaller than
+// MAX_SOURCE_SIZE. read_input refuses anything bigger.
+struct FlatDocument {
+    std::vector<ParagraphType> types;
+    std::vector<uint8_t> header_levels;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::string text;
+
+    // The one Markdown parser, which Document::parse_document and
+    // IncrementalDocument go through too. Takes a single pass over the source.
+    static FlatDocument parse(std::string_view source);
+
+    // Parses big documents in chunks of about `chunk_size` bytes on up to
+    // `thread_count` threads, cut at blank lines so that no paragraph is split
+    // between two chunks. The result is the same as parse's.
+    static FlatDocument parse_parallel(std::string_view source,
+                                       size_t thread_count = worker_count(),
+                                       size_t chunk_size = PARALLEL_CHUNK_SIZE);
+
+    static FlatDocument from_document(const Document &document);
+
+    Document to_document() const;
+
+    size_t size() const { return types.size(); }
+
+    std::string_view content(size_t i) const {
+        return std::string_view{text}.substr(offsets[i], lengths[i]);
+    }
+
+    std::string get_title() const;
+
+    // The on-disk form: a small header followed by each array in turn.
+    std::string serialize() const;
+
+    static std::tuple<FlatDocument, Error> deserialize(std::string_view bytes);
+
+    Error write_to_file(const std::filesystem::path &path) const;
+
+    // Maps the file into memory and reads the document out of it.
+    static std::tuple<FlatDocument, Error>
+    from_file(const std::filesystem::path &path);
+};
+} // namespace neng
@@ -0,0 +1,77 @@
+#include "fragment_cache.hpp"
+#include "hash.hpp"
+
+namespace neng {
+FragmentCache::FragmentCache(size_t max_bytes)
+    : max_shard_bytes{max_bytes / SHARD_COUNT} {}
+
+uint64_t
+FragmentCache::hash_configuration(const DocumentConfiguration &config) {
+    auto hash = fnv1a_hash(config.paragraph_class);
+    hash = fnv1a_hash(std::string_view{"\0", 1}, hash);
+    hash = fnv1a_hash(config.title_class, hash);
+    return fnv1a_hash(config.minify ? "1" : "0", hash);
+}
+
+uint64_t FragmentCache::hash_paragraph(uint64_t configuration_hash,
+                                       ParagraphType type,
+                                       uint8_t header_level,
+                                       std::string_view content) {
+    const char header[] = {static_cast<char>(type),
+                           static_cast<char>(header_level)};
+    return fnv1a_hash(content,
+                      fnv1a_hash({header, sizeof(header)}, configuration_hash));
+}
+
+bool FragmentCache::append_cached(uint64_t hash, ParagraphType type,
+                                  uint8_t header_level,
+                                  std::string_view content, std::string &out) {
+    auto &shard = shard_for(hash);
+
+    {
+        std::lock_guard lock{shard.mutex};
+        const auto found = shard.entries.find(hash);
+        if (found != shard.entries.end() && found->second.type == type &&
+            found->second.header_level == header_level &&
+            found->second.content == content) {
+            out += found->second.html;
+            hit_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void FragmentCache::insert(uint64_t hash, ParagraphType type,
+                           uint8_t header_level, std::string_view content,
+                           std::string_view html) {
+    const auto bytes = content.size() + html.size();
+    if (bytes > max_shard_bytes) {
+        return;
+    }
+
+    auto &shard = shard_for(hash);
+    std::lock_guard lock{shard.mutex};
+
+    if (shard.bytes + bytes > max_shard_bytes) {
+        // Rather than tracking what was used least recently, start over. The
+        // paragraphs worth caching are the ones that come up all the time, so
+        // they are back in no time.
+        shard.entries.clear();
+        shard.bytes = 0;
+    }
+
+    const auto [entry, inserted] = shard.entries.try_emplace(
+        hash, Entry{
+                  .type = type,
+                  .header_level = header_level,
+                  .content = std::string(content),
+                  .html = std::string(html),
+              });
+    if (inserted) {
+        shard.bytes += bytes;
+    }
+}
+} // namespace neng
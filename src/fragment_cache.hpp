@@ -0,0 +1,64 @@
+#pragma once
+
+#include "document.hpp"
+
+#include <atomic>
+#include <mutex>
+
+namespace neng {
+// The HTML of paragraphs that have been rendered before, shared between all of
+// the pages of a build, so that boilerplate repeated across thousands of pages
+// is only rendered once. Only minified paragraphs go through it, since a plain
+// one renders faster than it can be looked up. Entries are keyed by a hash of
+// the paragraph and the configuration it was rendered with, and hold on to the
+// paragraph itself so that a hash collision is never taken for a hit. Safe to
+// share between threads.
+class FragmentCache {
+  public:
+    // `max_bytes` bounds the content and HTML held by the cache.
+    explicit FragmentCache(size_t max_bytes);
+
+    // What sets one configuration's fragments apart from another's.
+    static uint64_t hash_configuration(const DocumentConfiguration &config);
+
+    static uint64_t hash_paragraph(uint64_t configuration_hash,
+                                   ParagraphType type, uint8_t header_level,
+                                   std::string_view content);
+
+    // Appends the cached HTML to `out` and returns true, or returns false if
+    // the paragraph has not been seen.
+    bool append_cached(uint64_t hash, ParagraphType type, uint8_t header_level,
+                       std::string_view content, std::string &out);
+
+    void insert(uint64_t hash, ParagraphType type, uint8_t header_level,
+                std::string_view content, std::string_view html);
+
+    size_t hits() const { return hit_count.load(); }
+    size_t misses() const { return miss_count.load(); }
+
+  private:
+    struct Entry {
+        ParagraphType type;
+        uint8_t header_level;
+        std::string content;
+        std::string html;
+    };
+
+    // The entries are split between shards by hash, each with its own lock,
+    // so that render threads rarely wait on each other.
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Entry> entries;
+        size_t bytes{0};
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+    Shard &shard_for(uint64_t hash) { return shards[hash % SHARD_COUNT]; }
+
+    size_t max_shard_bytes;
+    std::array<Shard, SHARD_COUNT> shards;
+    std::atomic<size_t> hit_count{0};
+    std::atomic<size_t> miss_count{0};
+};
+} // namespace neng
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace neng {
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325;
+
+// 64-bit FNV-1a. Pass the previous result back in as `hash` to hash something
+// a piece at a time.
+constexpr uint64_t fnv1a_hash(std::string_view bytes,
+                              uint64_t hash = FNV_OFFSET_BASIS) {
+    for (const auto byte : bytes) {
+        hash ^= static_cast<unsigned char>(byte);
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+} // namespace neng
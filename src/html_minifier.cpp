@@ -0,0 +1,239 @@
+#include "html_minifier.hpp"
+#include "lexer.hpp"
+
+#include <algorithm>
+
+namespace {
+struct PreservedElement {
+    std::string_view opening_tag;
+    std::string_view closing_tag;
+};
+
+// Whitespace means something inside of these, either to the reader or to the
+// script itself.
+constexpr std::array<PreservedElement, 4> PRESERVED_ELEMENTS{{
+    {"<pre", "</pre"},
+    {"<textarea", "</textarea"},
+    {"<script", "</script"},
+    {"<style", "</style"},
+}};
+
+constexpr std::string_view COMMENT_OPENING = "<!--";
+constexpr std::string_view COMMENT_CLOSING = "-->";
+
+// Elements that are laid out as blocks, or not shown at all, so whitespace
+// next to them never makes it onto the page.
+constexpr std::array<std::string_view, 49> BLOCK_ELEMENTS{
+    "!doctype", "address", "article", "aside",   "blockquote", "body",
+    "br",       "dd",      "details", "dialog",  "div",        "dl",
+    "dt",       "fieldset", "figcaption", "figure", "footer",  "form",
+    "h1",       "h2",      "h3",      "h4",      "h5",         "h6",
+    "head",     "header",  "hr",      "html",    "li",         "link",
+    "main",     "meta",    "nav",     "ol",      "p",          "pre",
+    "script",   "section", "style",   "summary", "table",      "tbody",
+    "td",       "tfoot",   "th",      "thead",   "title",      "tr",
+    "ul",
+};
+static_assert(std::is_sorted(BLOCK_ELEMENTS.begin(), BLOCK_ELEMENTS.end()));
+
+char to_lower(char character) {
+    return character >= 'A' && character <= 'Z' ? character - 'A' + 'a'
+                                                : character;
+}
+
+// Whether `html` starts with the lowercase `tag`, ignoring case.
+bool starts_with_tag(std::string_view html, std::string_view tag) {
+    if (html.size() < tag.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < tag.size(); i++) {
+        if (to_lower(html[i]) != tag[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Whether a tag name ends at the start of `after`, so that <preview> is not
+// taken for <pre>.
+bool ends_tag_name(std::string_view after) {
+    return after.empty() || after[0] == '>' || after[0] == '/' ||
+           neng::is_space(after[0]);
+}
+
+// Where the tag `closing_tag` next shows up in `html` from `from`, ignoring
+// case.
+size_t find_closing_tag(std::string_view html, std::string_view closing_tag,
+                        size_t from) {
+    if (closing_tag == COMMENT_CLOSING) {
+        return html.find(COMMENT_CLOSING, from);
+    }
+
+    for (auto i = html.find('<', from); i != std::string_view::npos;
+         i = html.find('<', i + 1)) {
+        const auto rest = html.substr(i);
+        if (starts_with_tag(rest, closing_tag) &&
+            ends_tag_name(rest.substr(closing_tag.size()))) {
+            return i;
+        }
+    }
+
+    return std::string_view::npos;
+}
+
+// Whether `html` opens one of the preserved elements, and which.
+const PreservedElement *opened_element(std::string_view html) {
+    for (const auto &element : PRESERVED_ELEMENTS) {
+        if (starts_with_tag(html, element.opening_tag) &&
+            ends_tag_name(html.substr(element.opening_tag.size()))) {
+            return &element;
+        }
+    }
+
+    return nullptr;
+}
+
+// Whether the < at the start of `html` starts a tag, rather than being a
+// stray < in the text.
+bool starts_tag(std::string_view html) {
+    if (html.size() < 2) {
+        return false;
+    }
+
+    const auto next = to_lower(html[1]);
+    return (next >= 'a' && next <= 'z') || next == '/' || next == '!';
+}
+
+// Whether the tag at the start of `html`, opening or closing, is one of the
+// block elements.
+bool is_block_tag(std::string_view html) {
+    size_t begin = 1;
+    if (begin < html.size() && html[begin] == '/') {
+        begin++;
+    }
+
+    std::string name;
+    for (auto i = begin; i < html.size() && !ends_tag_name(html.substr(i));
+         i++) {
+        name.push_back(to_lower(html[i]));
+    }
+
+    return std::binary_search(BLOCK_ELEMENTS.begin(), BLOCK_ELEMENTS.end(),
+                              name);
+}
+} // namespace
+
+namespace neng {
+void minify_html(std::string_view html, std::string &out, MinifyState &state) {
+    // Where the last tag in `html` ended, for telling the whitespace after it
+    // apart from whitespace after a > in the text.
+    auto tag_end = std::string_view::npos;
+
+    size_t i = 0;
+    while (i < html.size()) {
+        if (!state.closing_tag.empty()) {
+            const auto closing = find_closing_tag(html, state.closing_tag, i);
+            if (closing == std::string_view::npos) {
+                out.append(html.substr(i));
+                return;
+            }
+
+            const auto end = closing + state.closing_tag.size();
+            out.append(html.substr(i, end - i));
+
+            // The rest of a closing tag, like the > of </pre>, is read as any
+            // other tag. A comment is already over.
+            state.in_tag = state.closing_tag != COMMENT_CLOSING;
+            state.block_tag = state.in_tag && is_block_tag(html.substr(closing));
+            if (!state.in_tag) {
+                tag_end = end;
+            }
+            state.closing_tag = {};
+            i = end;
+            continue;
+        }
+
+        const auto character = html[i];
+
+        if (state.quote != 0) {
+            const auto quote_end = html.find(state.quote, i);
+            const auto end =
+                quote_end == std::string_view::npos ? html.size() : quote_end + 1;
+            out.append(html.substr(i, end - i));
+            if (quote_end != std::string_view::npos) {
+                state.quote = 0;
+            }
+            i = end;
+            continue;
+        }
+
+        if (is_space(character)) {
+            auto run_end = i;
+            bool has_line_break = false;
+            while (run_end < html.size() && is_space(html[run_end])) {
+                has_line_break |= html[run_end] == '\n';
+                run_end++;
+            }
+
+            const bool between_tags = !state.in_tag && tag_end == i &&
+                                      run_end < html.size() &&
+                                      html[run_end] == '<' &&
+                                      starts_tag(html.substr(run_end));
+            if (!(between_tags && has_line_break &&
+                  (state.block_tag || is_block_tag(html.substr(run_end))))) {
+                out.push_back(' ');
+            }
+
+            i = run_end;
+            continue;
+        }
+
+        if (state.in_tag) {
+            // Quotes only start a value right after the =, so the ' in an
+            // unquoted title=don't does not.
+            const bool after_equals =
+                !out.empty() &&
+                (out.back() == '=' ||
+                 (out.back() == ' ' && out.size() > 1 &&
+                  out[out.size() - 2] == '='));
+            if ((character == '"' || character == '\'') && after_equals) {
+                state.quote = character;
+            } else if (character == '>') {
+                state.in_tag = false;
+                tag_end = i + 1;
+            }
+
+            out.push_back(character);
+            i++;
+            continue;
+        }
+
+        if (character == '<' && starts_tag(html.substr(i))) {
+            const auto rest = html.substr(i);
+
+            if (rest.starts_with(COMMENT_OPENING)) {
+                out.append(COMMENT_OPENING);
+                state.closing_tag = COMMENT_CLOSING;
+                i += COMMENT_OPENING.size();
+                continue;
+            }
+
+            state.block_tag = is_block_tag(rest);
+
+            if (const auto element = opened_element(rest)) {
+                out.append(rest.substr(0, element->opening_tag.size()));
+                state.closing_tag = element->closing_tag;
+                i += element->opening_tag.size();
+                continue;
+            }
+
+            state.in_tag = true;
+        }
+
+        out.push_back(character);
+        i++;
+    }
+}
+} // namespace neng
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace neng {
+// Where minify_html left off, carried over from one piece of HTML to the next
+// so that an element, tag or attribute value can span several of them.
+struct MinifyState {
+    // The start of the tag that ends the element whose content is being kept
+    // as it is, like "</pre", or "-->" inside of a comment. Empty otherwise.
+    std::string_view closing_tag;
+    // Inside of a tag, between its < and >.
+    bool in_tag{false};
+    // The quote around the attribute value being read, if any.
+    char quote{0};
+    // Whether the tag being read, or else the last one read, is block-level.
+    bool block_tag{false};
+};
+
+// Appends `html` to `out` with its whitespace collapsed, without changing any
+// text that the page shows. Every run of whitespace becomes a single space,
+// except for runs that hold a line break and sit between two tags, at least
+// one of them block-level, since those never show. Attribute values,
+// comments, and the content of <pre>, <textarea>, <script> and <style> are
+// left alone.
+void minify_html(std::string_view html, std::string &out, MinifyState &state);
+
+inline std::string minify_html(std::string_view html) {
+    std::string out;
+    MinifyState state;
+    minify_html(html, out, state);
+    return out;
+}
+} // namespace neng
@@ -0,0 +1,234 @@
+#include "incremental_document.hpp"
+#include "flat_document.hpp"
+#include "lexer.hpp"
+
+namespace {
+using neng::IncrementalDocument;
+using neng::LineKind;
+using neng::Paragraph;
+using neng::ParagraphType;
+
+// Parses the lines of `source` from `region_begin` to `region_end`, which
+// have to be the start and the end of a line, into blocks.
+std::vector<IncrementalDocument::Block>
+parse_blocks(std::string_view source, size_t region_begin, size_t region_end,
+             std::string_view paragraph_class, std::string_view title_class,
+             bool minify) {
+    std::vector<IncrementalDocument::Block> blocks;
+    bool in_block = false;
+    auto last_kind = LineKind::BLANK;
+
+    const auto finish_block = [&]() {
+        auto &block = blocks.back();
+        block.ends_with_text = last_kind == LineKind::TEXT;
+
+        // A block has no blank lines in it, so the paragraph that the parser
+        // ends it with is either its last line of text or an empty stand-in.
+        block.paragraphs =
+            neng::FlatDocument::parse(
+                source.substr(block.begin, block.end - block.begin))
+                .to_document()
+                .paragraphs;
+        if (!block.ends_with_text) {
+            block.paragraphs.pop_back();
+        }
+
+        block.fragments.reserve(block.paragraphs.size());
+        for (const auto &paragraph : block.paragraphs) {
+            block.fragments.push_back(
+                paragraph.render_to_html(paragraph_class, title_class, minify));
+        }
+
+        in_block = false;
+    };
+
+    for (size_t line_begin = region_begin;;) {
+        const auto line_end =
+            std::min(source.find('\n', line_begin), region_end);
+        const auto line = source.substr(line_begin, line_end - line_begin);
+        const auto kind = neng::lex_line(line).kind;
+
+        if (kind == LineKind::BLANK) {
+            if (in_block) {
+                finish_block();
+            }
+        } else {
+            if (!in_block) {
+                blocks.push_back({
+                    .begin = line_begin,
+                    .end = line_end,
+                    .paragraphs = {},
+                    .fragments = {},
+                    .ends_with_text = false,
+                });
+                in_block = true;
+            }
+
+            blocks.back().end = line_end;
+            last_kind = kind;
+        }
+
+        if (line_end >= region_end) {
+            break;
+        }
+        line_begin = line_end + 1;
+    }
+
+    if (in_block) {
+        finish_block();
+    }
+
+    return blocks;
+}
+
+// The parser ends every document with whatever paragraph is still pending at
+// the end of the source, which is an empty one unless the very last line is
+// text. In that case the block's last paragraph is that final paragraph.
+bool needs_final_paragraph(const IncrementalDocument &document) {
+    const auto &blocks = document.blocks;
+    return blocks.empty() || !blocks.back().ends_with_text ||
+           blocks.back().end != document.source.size();
+}
+} // namespace
+
+namespace neng {
+IncrementalDocument
+IncrementalDocument::parse(std::string source,
+                           const DocumentConfiguration &config) {
+    IncrementalDocument document{
+        .source = std::move(source),
+        .blocks = {},
+        .paragraph_class = config.paragraph_class,
+        .title_class = config.title_class,
+        .minify = config.minify,
+    };
+
+    document.blocks =
+        parse_blocks(document.source, 0, document.source.size(),
+                     document.paragraph_class, document.title_class,
+                     document.minify);
+
+    return document;
+}
+
+void IncrementalDocument::update(std::string new_source,
+                                 const DocumentConfiguration &config) {
+    if (config.paragraph_class != paragraph_class ||
+        config.title_class != title_class || config.minify != minify) {
+        // Every fragment is stale.
+        *this = parse(std::move(new_source), config);
+        return;
+    }
+
+    const auto &old_source = source;
+    const auto shortest = std::min(old_source.size(), new_source.size());
+
+    size_t prefix = 0;
+    while (prefix < shortest && old_source[prefix] == new_source[prefix]) {
+        prefix++;
+    }
+
+    if (prefix == old_source.size() && prefix == new_source.size()) {
+        return;
+    }
+
+    size_t suffix = 0;
+    while (suffix < shortest - prefix &&
+           old_source[old_source.size() - 1 - suffix] ==
+               new_source[new_source.size() - 1 - suffix]) {
+        suffix++;
+    }
+
+    // Widen the change out to whole lines of the old source. Everything
+    // before `line_begin` and after `line_end` is the same in both sources.
+    const auto newline_before =
+        prefix == 0 ? std::string::npos : old_source.rfind('\n', prefix - 1);
+    const auto line_begin =
+        newline_before == std::string::npos ? 0 : newline_before + 1;
+    const auto line_end =
+        std::min(old_source.find('\n', old_source.size() - suffix),
+                 old_source.size());
+
+    // Blocks right next to the changed lines are included too, since the
+    // edit may have joined them to it.
+    size_t first = 0;
+    while (first < blocks.size() && blocks[first].end + 1 < line_begin) {
+        first++;
+    }
+
+    size_t last = first;
+    while (last < blocks.size() && blocks[last].begin <= line_end + 1) {
+        last++;
+    }
+
+    auto region_begin = line_begin;
+    auto region_end = line_end;
+    if (first < last) {
+        region_begin = std::min(region_begin, blocks[first].begin);
+        region_end = std::max(region_end, blocks[last - 1].end);
+    }
+
+    const auto shift = static_cast<ptrdiff_t>(new_source.size()) -
+                       static_cast<ptrdiff_t>(old_source.size());
+
+    auto new_blocks = parse_blocks(new_source, region_begin,
+                                   region_end + shift, paragraph_class,
+                                   title_class, minify);
+
+    for (auto block = blocks.begin() + last; block != blocks.end(); block++) {
+        block->begin += shift;
+        block->end += shift;
+    }
+
+    blocks.erase(blocks.begin() + first, blocks.begin() + last);
+    blocks.insert(blocks.begin() + first,
+                  std::make_move_iterator(new_blocks.begin()),
+                  std::make_move_iterator(new_blocks.end()));
+
+    source = std::move(new_source);
+}
+
+Document IncrementalDocument::to_document() const {
+    Document document;
+    for (const auto &block : blocks) {
+        document.paragraphs.insert(document.paragraphs.end(),
+                                   block.paragraphs.begin(),
+                                   block.paragraphs.end());
+    }
+
+    if (needs_final_paragraph(*this)) {
+        document.paragraphs.push_back(
+            {.type = ParagraphType::NORMAL, .content = {}});
+    }
+
+    return document;
+}
+
+std::string IncrementalDocument::render_html() const {
+    std::string html;
+    for (const auto &block : blocks) {
+        for (const auto &fragment : block.fragments) {
+            html += fragment;
+        }
+    }
+
+    if (needs_final_paragraph(*this)) {
+        html += Paragraph{.type = ParagraphType::NORMAL, .content = {}}
+                    .render_to_html(paragraph_class, title_class, minify);
+    }
+
+    return html;
+}
+
+std::string IncrementalDocument::get_title() const {
+    for (const auto &block : blocks) {
+        for (const auto &paragraph : block.paragraphs) {
+            if (paragraph.type == ParagraphType::HEADER) {
+                return paragraph.content;
+            }
+        }
+    }
+
+    return "";
+}
+} // namespace neng
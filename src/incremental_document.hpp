@@ -0,0 +1,49 @@
+#pragma once
+
+#include "document.hpp"
+
+namespace neng {
+// A parsed document that remembers where each of its paragraphs came from and
+// what HTML each one rendered to, so that an edited version of the source
+// only has the paragraphs around the edit re-parsed and re-rendered.
+//
+// The source is cut into blocks, which are runs of non-blank lines. The
+// parser forgets everything at a blank line, so a block always parses to the
+// same paragraphs no matter what surrounds it.
+struct IncrementalDocument {
+    struct Block {
+        // The block's lines in the source, from the start of the first to the
+        // end of the last (not counting the newline).
+        size_t begin;
+        size_t end;
+        std::vector<Paragraph> paragraphs;
+        std::vector<std::string> fragments;
+        // Whether the block's last line is text rather than a heading. If the
+        // block is also at the very end of the source, its last paragraph
+        // doubles as the one the parser ends every document with.
+        bool ends_with_text;
+    };
+
+    std::string source;
+    std::vector<Block> blocks;
+    std::string paragraph_class;
+    std::string title_class;
+    bool minify;
+
+    static IncrementalDocument parse(std::string source,
+                                     const DocumentConfiguration &config);
+
+    // Brings the document up to date with `new_source`. Only the blocks that
+    // touch the part of the source that differs are parsed again.
+    void update(std::string new_source, const DocumentConfiguration &config);
+
+    // The same document that Document::parse_document would produce.
+    Document to_document() const;
+
+    // The same HTML that DocumentConfiguration::render_html_to_string would
+    // produce, put together from the cached fragments.
+    std::string render_html() const;
+
+    std::string get_title() const;
+};
+} // namespace neng
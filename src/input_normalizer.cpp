@@ -0,0 +1,198 @@
+#include "input_normalizer.hpp"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr std::string_view BYTE_ORDER_MARK = "\xEF\xBB\xBF";
+
+bool is_continuation(unsigned char byte) { return (byte & 0xC0) == 0x80; }
+
+// The length of the UTF-8 sequence at the start of `bytes`, or 0 if it is not
+// a valid one. Overlong forms, surrogates and anything past U+10FFFF are all
+// invalid.
+size_t sequence_length(const unsigned char *bytes, size_t available) {
+    const auto lead = bytes[0];
+
+    size_t length;
+    unsigned char second_min = 0x80;
+    unsigned char second_max = 0xBF;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) {
+            second_min = 0xA0;
+        } else if (lead == 0xED) {
+            second_max = 0x9F;
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) {
+            second_min = 0x90;
+        } else if (lead == 0xF4) {
+            second_max = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+
+    if (available < length || bytes[1] < second_min || bytes[1] > second_max) {
+        return 0;
+    }
+
+    for (size_t i = 2; i < length; i++) {
+        if (!is_continuation(bytes[i])) {
+            return 0;
+        }
+    }
+
+    return length;
+}
+
+// Where the end of `text` is, given that it is valid UTF-8 with LF line
+// endings.
+neng::TextPosition end_position(std::string_view text) {
+    const auto newline = text.find_last_of('\n');
+    const auto line_begin = newline == std::string_view::npos ? 0 : newline + 1;
+
+    neng::TextPosition position{.line = 1, .column = 1};
+    for (const auto character : text) {
+        position.line += character == '\n';
+    }
+    for (size_t i = line_begin; i < text.size(); i++) {
+        position.column +=
+            !is_continuation(static_cast<unsigned char>(text[i]));
+    }
+
+    return position;
+}
+} // namespace
+
+namespace neng {
+std::tuple<TextPosition, Error> normalize_input(std::string &source) {
+    auto *data = reinterpret_cast<unsigned char *>(source.data());
+    const auto size = source.size();
+
+    // Everything before `write` is done; everything from `read` on is not.
+    // Line endings only ever get shorter, so `write` never passes `read`.
+    size_t read = std::string_view{source}.starts_with(BYTE_ORDER_MARK)
+                      ? BYTE_ORDER_MARK.size()
+                      : 0;
+    size_t write = 0;
+
+    while (read < size) {
+#ifdef __SSE2__
+        // Skip through plain ASCII without any CRs 16 bytes at a time.
+        const auto carriage_returns = _mm_set1_epi8('\r');
+        while (read + 16 <= size) {
+            const auto chunk = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(data + read));
+            const auto stops =
+                _mm_movemask_epi8(chunk) |
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, carriage_returns));
+
+            if (stops != 0) {
+                const auto plain = static_cast<size_t>(__builtin_ctz(stops));
+                if (write != read) {
+                    std::memmove(data + write, data + read, plain);
+                }
+                read += plain;
+                write += plain;
+                break;
+            }
+
+            if (write != read) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(data + write),
+                                 chunk);
+            }
+            read += 16;
+            write += 16;
+        }
+
+        if (read >= size) {
+            break;
+        }
+#endif
+
+        const auto byte = data[read];
+
+        if (byte == '\r') {
+            data[write++] = '\n';
+            read += read + 1 < size && data[read + 1] == '\n' ? 2 : 1;
+            continue;
+        }
+
+        if (byte < 0x80) {
+            data[write++] = byte;
+            read++;
+            continue;
+        }
+
+        // Text in most scripts other than Latin is multibyte sequences back
+        // to back, with the odd space or punctuation mark in between, so stay
+        // here until the next ASCII byte rather than going back to the
+        // vector loop for every character.
+        do {
+            const auto length = sequence_length(data + read, size - read);
+            if (length == 0) {
+                return {
+                    end_position(std::string_view{source}.substr(0, write)),
+                    Error::INVALID_UTF8};
+            }
+
+            if (write != read) {
+                for (size_t i = 0; i < length; i++) {
+                    data[write + i] = data[read + i];
+                }
+            }
+            read += length;
+            write += length;
+        } while (read < size && data[read] >= 0x80);
+    }
+
+    source.resize(write);
+    return {{}, Error::OK};
+}
+
+Error normalize_input(std::string &source, const std::filesystem::path &path) {
+    const auto [position, error] = normalize_input(source);
+    if (error == Error::INVALID_UTF8) {
+        std::cerr << "[ERROR]: " << path.string() << ":" << position.line
+                  << ":" << position.column << ": Invalid UTF-8\n";
+    }
+
+    return error;
+}
+
+std::tuple<std::string, Error> read_input(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return {"", Error::FILE_OPEN_ERROR};
+    }
+
+    const auto size = static_cast<size_t>(file.tellg());
+    if (size >= MAX_SOURCE_SIZE) {
+        std::cerr << "[ERROR]: " << path.string()
+                  << ": Too large, sources have to be under 4 GiB\n";
+        return {"", Error::FILE_TOO_LARGE};
+    }
+
+    std::string source(size, '\0');
+    file.seekg(0);
+    if (!file.read(source.data(), source.size())) {
+        return {"", Error::FILE_READ_ERROR};
+    }
+
+    const auto error = normalize_input(source, path);
+    if (error != Error::OK) {
+        return {"", error};
+    }
+
+    return {std::move(source), Error::OK};
+}
+} // namespace neng
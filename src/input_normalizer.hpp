@@ -0,0 +1,29 @@
+#pragma once
+
+#include "document.hpp"
+
+namespace neng {
+// A place in a text file, counting from 1. Columns count characters, not
+// bytes.
+struct TextPosition {
+    size_t line;
+    size_t column;
+};
+
+// Gets a freshly read source ready for parsing, in place and in a single pass:
+// strips a UTF-8 byte order mark, turns CRLF and lone CR line endings into LF,
+// and checks that the text is valid UTF-8. Only runs of plain ASCII without a
+// CR are handled 16 bytes at a time, where SSE2 is available; multibyte
+// characters are checked and moved one sequence at a time.
+//
+// On Error::INVALID_UTF8, the position is that of the first bad byte, and the
+// source is left half normalized.
+std::tuple<TextPosition, Error> normalize_input(std::string &source);
+
+// Same as above, but reports an error as "<path>:<line>:<column>".
+Error normalize_input(std::string &source, const std::filesystem::path &path);
+
+// Reads the file at `path` whole and normalizes it, ready for parsing. Files
+// of MAX_SOURCE_SIZE or more are refused with Error::FILE_TOO_LARGE.
+std::tuple<std::string, Error> read_input(const std::filesystem::path &path);
+} // namespace neng
@@ -0,0 +1,95 @@
+#include "lexer.hpp"
+
+namespace neng {
+LineToken lex_line(std::string_view line) {
+    size_t begin = line.size();
+    size_t end = 0;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        if (!is_space(line[i])) {
+            if (begin == line.size()) {
+                begin = i;
+            }
+            end = i + 1;
+        }
+    }
+
+    if (begin == line.size()) {
+        return {
+            .kind = LineKind::BLANK,
+            .header_level = 0,
+            .content_begin = 0,
+            .content_end = 0,
+        };
+    }
+
+    // A heading is a run of #s followed by a space, inside of the trimmed
+    // line.
+    size_t hashes_end = begin;
+    while (hashes_end < end &&
+           CHARACTER_CLASSES[static_cast<unsigned char>(line[hashes_end])] &
+               CHARACTER_HASH) {
+        hashes_end++;
+    }
+
+    const auto header_level = static_cast<uint8_t>(hashes_end - begin);
+    if (header_level > 0 && hashes_end < end && line[hashes_end] == ' ') {
+        size_t title_begin = hashes_end + 1;
+        while (title_begin < end && is_space(line[title_begin])) {
+            title_begin++;
+        }
+
+        return {
+            .kind = LineKind::HEADING,
+            .header_level = header_level,
+            .content_begin = title_begin,
+            .content_end = end,
+        };
+    }
+
+    return {
+        .kind = LineKind::TEXT,
+        .header_level = 0,
+        .content_begin = begin,
+        .content_end = end,
+    };
+}
+
+std::vector<std::string_view> split_at_blank_lines(std::string_view source,
+                                                   size_t chunk_size) {
+    std::vector<std::string_view> chunks;
+    chunk_size = std::max<size_t>(chunk_size, 1);
+
+    size_t chunk_begin = 0;
+    while (source.size() - chunk_begin > chunk_size) {
+        // Look for a blank line from the first full line past the target.
+        auto line_begin = source.find('\n', chunk_begin + chunk_size);
+        size_t cut = std::string_view::npos;
+
+        while (line_begin != std::string_view::npos) {
+            line_begin++;
+            const auto line_end = source.find('\n', line_begin);
+            if (line_end == std::string_view::npos) {
+                break;
+            }
+
+            const auto line = source.substr(line_begin, line_end - line_begin);
+            if (lex_line(line).kind == LineKind::BLANK) {
+                cut = line_end + 1;
+                break;
+            }
+            line_begin = line_end;
+        }
+
+        if (cut == std::string_view::npos) {
+            break;
+        }
+
+        chunks.push_back(source.substr(chunk_begin, cut - chunk_begin));
+        chunk_begin = cut;
+    }
+
+    chunks.push_back(source.substr(chunk_begin));
+    return chunks;
+}
+} // namespace neng
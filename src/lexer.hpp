@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace neng {
+// Character classes, looked up in a table instead of going through the
+// locale-dependent <cctype> functions.
+enum CharacterClass : uint8_t {
+    // The same set as std::isspace in the "C" locale.
+    CHARACTER_SPACE = 1 << 0,
+    CHARACTER_HASH = 1 << 1,
+};
+
+constexpr std::array<uint8_t, 256> CHARACTER_CLASSES = []() {
+    std::array<uint8_t, 256> classes{};
+    for (const unsigned char character : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+        classes[character] |= CHARACTER_SPACE;
+    }
+    classes['#'] |= CHARACTER_HASH;
+
+    return classes;
+}();
+
+constexpr bool is_space(char character) {
+    return CHARACTER_CLASSES[static_cast<unsigned char>(character)] &
+           CHARACTER_SPACE;
+}
+
+enum class LineKind { BLANK, HEADING, TEXT };
+
+// What a single line of a document turns out to be, and where its content is.
+// The content is line.substr(content_begin, content_end - content_begin): the
+// trimmed line for text, or the trimmed title for headings.
+struct LineToken {
+    LineKind kind;
+    uint8_t header_level;
+    size_t content_begin;
+    size_t content_end;
+};
+
+// Classifies a line in a single pass over it.
+LineToken lex_line(std::string_view line);
+
+// Cuts `source` into pieces of roughly `chunk_size` bytes. Every piece but the
+// last ends right after a blank line, and since a blank line ends whatever
+// paragraph came before it, the pieces can be parsed on their own.
+std::vector<std::string_view> split_at_blank_lines(std::string_view source,
+                                                   size_t chunk_size);
+} // namespace neng
@@ -1,45 +1,169 @@
+#include "asset_copier.hpp"
+#include "asset_fingerprints.hpp"
+#include "batch.hpp"
+#include "directory_walker.hpp"
 #include "document.hpp"
 #include "document_template.hpp"
+#include "embedded_template.hpp"
+#include "fragment_cache.hpp"
+#include "page_scheduler.hpp"
+#include "parallel.hpp"
+#include "render_daemon.hpp"
+#include "render_pipeline.hpp"
+#include "sharding.hpp"
+#include "string_utils.hpp"
+#include "tar_writer.hpp"
+#include "template_cache.hpp"
 #include "tests.hpp"
 
+#include <charconv>
+#include <csignal>
+#include <cstdio>
 #include <fstream>
+#include <numeric>
 #include <optional>
+#include <unordered_set>
 
 using namespace std::literals::string_literals;
 namespace fs = std::filesystem;
 
 namespace {
-using neng::Document;
 using neng::DocumentConfiguration;
 using neng::DocumentTemplate;
 using neng::Error;
+using neng::Page;
+
+// Set by SIGINT and SIGTERM, for the daemon to shut down cleanly on.
+std::atomic<bool> daemon_stop{false};
+
+void stop_daemon(int) { daemon_stop = true; }
+
+struct BuildOptions {
+    // When set, every output goes into this archive instead of the output
+    // directory.
+    std::optional<fs::path> archive_path;
+    neng::AssetCopyMode asset_copy_mode{neng::AssetCopyMode::COPY};
+    neng::PipelineOptions pipeline;
+    bool minify{false};
+    // Renders only this shard's pages. See assign_shards.
+    std::optional<neng::ShardSpec> shard;
+    // How big the fragment cache may get. Zero turns it off.
+    size_t fragment_cache_size{0};
+};
+
+// Sets up the fragment cache for `config`, if one was asked for. Only minified
+// paragraphs go through it: a plain paragraph is copied into the HTML as it
+// is, which is quicker than hashing it and looking it up.
+void attach_fragment_cache(size_t max_bytes, DocumentConfiguration &config,
+                           std::optional<neng::FragmentCache> &cache) {
+    if (max_bytes == 0) {
+        return;
+    }
+
+    if (!config.minify) {
+        std::cerr << "[INFO]: The fragment cache is only used with --minify, "
+                     "so it is off.\n";
+        return;
+    }
+
+    cache.emplace(max_bytes);
+    config.fragment_cache = &*cache;
+}
+
+void report_fragment_cache(const std::optional<neng::FragmentCache> &cache) {
+    if (cache) {
+        std::cerr << "[INFO]: Fragment cache: " << cache->hits() << " hits, "
+                  << cache->misses() << " misses.\n";
+    }
+}
 
-Error render_single_file(const fs::path &in_path, const fs::path &out_path,
-                         const DocumentConfiguration &document_config,
-                         const DocumentTemplate &document_template) {
-    const auto [document, error] = Document::parse_document_from_file(in_path);
+// Compares how long parsing and rendering took from start to finish with how
+// long it would have taken if the same CPU time had been spread perfectly over
+// `workers` cores. A core gets through at most a nanosecond of CPU time per
+// nanosecond on the clock, so no schedule can beat that. Pages split between
+// threads only count the calling thread's share of their CPU time, so with big
+// pages the bound comes out lower than it should.
+void report_schedule(const neng::PipelineStats &stats, size_t workers) {
+    if (stats.page_nanoseconds.empty()) {
+        return;
+    }
+
+    const auto milliseconds = [](uint64_t nanoseconds) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.1f ms",
+                      static_cast<double>(nanoseconds) / 1e6);
+        return std::string{buffer};
+    };
+
+    const auto total =
+        std::accumulate(stats.page_nanoseconds.begin(),
+                        stats.page_nanoseconds.end(), uint64_t{0});
+    const auto lower_bound =
+        neng::makespan_lower_bound(stats.page_nanoseconds, workers);
+    std::cerr << "[INFO]: Parsed and rendered " << stats.page_nanoseconds.size()
+              << " pages in " << milliseconds(stats.render_span_nanoseconds)
+              << ", against a lower bound of " << milliseconds(lower_bound)
+              << " for their " << milliseconds(total) << " of CPU time on "
+              << workers << (workers == 1 ? " core.\n" : " cores.\n");
+}
+
+// Anything in the pages directory that is not a page or a template.
+struct Asset {
+    fs::path input;
+    // The path of the output relative to the output directory.
+    std::string output;
+};
+
+// Where a build keeps what it wants to remember for the next one. It lives in
+// the input directory, so that it never ends up on the site itself.
+fs::path build_cache_path(const fs::path &in_path, std::string_view name) {
+    const auto cache_directory = in_path / ".neng-cache";
+    std::error_code error_code;
+    fs::create_directories(cache_directory, error_code);
+    return cache_directory / name;
+}
+
+// Renders the pages into the archive in the order they are listed, so the
+// archive comes out the same on every build. The assets are appended after all
+// of the pages.
+Error render_pages_to_archive(const std::vector<Page> &pages,
+                              const std::vector<Asset> &assets,
+                              const DocumentConfiguration &document_config,
+                              neng::PipelineOptions pipeline_options,
+                              const fs::path &archive_path) {
+    auto [archive, error] = neng::TarWriter::open(archive_path);
     if (error != Error::OK) {
+        std::cerr << "[ERROR]: Failed to open " << archive_path << ": "
+                  << error << '\n';
         return error;
     }
 
-    const auto rendered_result =
-        document_config.render_html_to_string(document);
-    const auto slotted_result = document_template.render_to_string(
-        document.get_title(), rendered_result);
+    pipeline_options.ordered_output = true;
+    auto write_error = neng::run_render_pipeline(
+        pages, document_config, pipeline_options,
+        [&](const Page &page, std::string_view html) {
+            return archive.add_file(page.output, html);
+        });
 
-    std::ofstream out_file(out_path);
-    if (!out_file.is_open()) {
-        return Error::FILE_OPEN_ERROR;
+    for (const auto &asset : assets) {
+        if (write_error != Error::OK) {
+            break;
+        }
+        write_error = archive.add_file_from_disk(asset.output, asset.input);
     }
 
-    out_file << slotted_result;
+    const auto finish_error = archive.finish();
+    if (write_error != Error::OK) {
+        return write_error;
+    }
 
-    return Error::OK;
+    return finish_error;
 }
 
 Error render_directory(const fs::path &config_path,
-                       const fs::path &template_path, const fs::path &in_path,
-                       const fs::path &out_path) {
+                       const std::optional<fs::path> &template_path,
+                       const fs::path &in_path, const fs::path &out_path,
+                       const BuildOptions &options) {
     if (!fs::exists(config_path)) {
         std::cerr << "[ERROR]: config.neng file does not exist. Make sure a "
                      "config.neng file exists in "
@@ -47,30 +171,38 @@ Error render_directory(const fs::path &config_path,
         return Error::FILE_DOES_NOT_EXIST;
     }
 
-    if (!fs::exists(template_path)) {
+    if ((template_path || !neng::HAS_EMBEDDED_TEMPLATE) &&
+        !fs::exists(template_path.value_or(neng::DEFAULT_TEMPLATE_PATH))) {
         std::cerr << "[ERROR]: template.html file does not exist. Make sure a "
                      "template.html file exists in "
                   << in_path << '\n';
         return Error::FILE_DOES_NOT_EXIST;
     }
 
-    const auto [document_config, error] =
+    auto [document_config, error] =
         DocumentConfiguration::from_file(config_path.string());
     if (error != Error::OK) {
         std::cerr << "[ERROR]: Failed to parse the configuration: " << error
                   << '\n';
         return error;
     }
+    document_config.minify |= options.minify;
 
-    const auto [document_template, error2] =
-        neng::DocumentTemplate::from_file(template_path);
+    std::optional<neng::FragmentCache> fragment_cache;
+    attach_fragment_cache(options.fragment_cache_size, document_config,
+                          fragment_cache);
+
+    auto [document_template, error2] = neng::load_template(template_path);
     if (error2 != Error::OK) {
-        std::cerr << "[ERROR]: Failed to parse the template: " << error << '\n';
-        return error;
+        std::cerr << "[ERROR]: Failed to parse the template: " << error2
+                  << '\n';
+        return error2;
     }
 
     // Ensure the output directory exists
-    fs::create_directory(out_path);
+    if (!options.archive_path) {
+        fs::create_directory(out_path);
+    }
 
     fs::path pages_path = in_path / "pages/";
 
@@ -79,25 +211,240 @@ Error render_directory(const fs::path &config_path,
         return Error::NO_PAGES_DIRECTORY;
     }
 
-    for (const auto &file : fs::recursive_directory_iterator{in_path}) {
-        using neng::Document;
+    // Only the pages directory is walked, so an output directory that lives
+    // inside of the input directory is never picked up.
+    const auto is_page = neng::has_extension(".md");
+    const auto [page_files, error3] = neng::walk_directory(
+        pages_path, [](std::string_view) { return true; });
+    if (error3 != Error::OK) {
+        return error3;
+    }
+
+    const auto is_template = [](std::string_view file) {
+        return file == "template.html" || file.ends_with("/template.html");
+    };
 
-        const auto file_path = file.path();
-        if (file_path.extension() == ".md") {
-            const auto file_output =
-                out_path /
-                fs::relative(file_path, in_path).replace_extension(".html");
+    std::vector<std::string> template_files;
+    for (const auto &file : page_files) {
+        if (is_template(file)) {
+            template_files.push_back(file);
+        }
+    }
 
-            auto file_output_dir = file_output;
-            file_output_dir.remove_filename();
+    // Any template.html inside of the pages directory overrides the template
+    // for its own subtree.
+    auto [template_cache, error4] = neng::TemplateCache::from_files(
+        pages_path, std::move(document_template), template_files);
+    if (error4 != Error::OK) {
+        return error4;
+    }
 
-            fs::create_directories(file_output_dir);
+    if (document_config.minify) {
+        template_cache.minify();
+    }
+
+    // Assets referred to with ${{asset path}} get a copy with the hash of
+    // their contents in the name, on top of the copy under their own name.
+    neng::AssetFingerprints asset_fingerprints{pages_path};
+    const auto asset_cache_path = build_cache_path(in_path, "assets");
+    asset_fingerprints.load_cache(asset_cache_path);
 
-            render_single_file(file_path, file_output, document_config,
-                               document_template);
+    const auto error5 = template_cache.resolve_assets(asset_fingerprints);
+    if (error5 != Error::OK) {
+        std::cerr << "[ERROR]: Failed to fingerprint the assets: " << error5
+                  << '\n';
+        return error5;
+    }
+
+    if (asset_fingerprints.save_cache(asset_cache_path) != Error::OK) {
+        std::cerr << "[ERROR]: Failed to save " << asset_cache_path << '\n';
+    }
+
+    // The previous build's manifest decides which shard each page goes to.
+    const auto manifest_path = build_cache_path(in_path, "manifest");
+    std::vector<size_t> page_shards;
+    if (options.shard) {
+        std::vector<std::string> page_paths;
+        for (const auto &file : page_files) {
+            if (is_page(file)) {
+                page_paths.push_back(file);
+            }
+        }
+
+        const auto [previous_manifest, manifest_error] =
+            neng::BuildManifest::from_file(manifest_path);
+        page_shards = neng::assign_shards(
+            page_paths, options.shard->count,
+            manifest_error == Error::OK ? &previous_manifest : nullptr);
+    }
+
+    // Everything that is not a page belongs to the whole site, so with
+    // --shard, it only comes out of the first shard.
+    const bool with_assets = !options.shard || options.shard->index == 0;
+
+    std::vector<Page> pages;
+    std::vector<Asset> assets;
+    pages.reserve(page_files.size());
+
+    neng::BuildManifest manifest;
+    if (options.shard) {
+        manifest.shard_index = options.shard->index;
+        manifest.shard_count = options.shard->count;
+    }
+
+    // Pages are sorted, so most of the lookups in here hit the directory that
+    // was just created, but the set also catches directories revisited later.
+    std::unordered_set<std::string_view> created_directories;
+    const auto out_pages_path = out_path / "pages";
+    size_t page_index = 0;
+
+    for (const auto &file : page_files) {
+        if (is_template(file)) {
+            continue;
+        }
+
+        const bool page = is_page(file);
+        if (page ? options.shard &&
+                       page_shards[page_index++] != options.shard->index
+                 : !with_assets) {
+            continue;
+        }
+
+        const auto separator = file.find_last_of('/');
+        const auto directory = std::string_view{file}.substr(
+            0, separator == std::string::npos ? 0 : separator);
+
+        if (!options.archive_path &&
+            created_directories.insert(directory).second) {
+            fs::create_directories(out_pages_path / directory);
+        }
+
+        if (!page) {
+            assets.push_back({
+                .input = pages_path / file,
+                .output = "pages/" + file,
+            });
+            continue;
+        }
+
+        pages.push_back({
+            .input = pages_path / file,
+            .output = "pages/" + file.substr(0, file.size() - 3) + ".html",
+            .document_template = &template_cache.find(directory),
+        });
+
+        std::error_code error_code;
+        const auto size = fs::file_size(pages.back().input, error_code);
+        manifest.pages.push_back({
+            .input = file,
+            .output = pages.back().output,
+            .size = error_code ? 0 : static_cast<size_t>(size),
+        });
+    }
+
+    if (with_assets) {
+        for (const auto &asset : asset_fingerprints.assets()) {
+            assets.push_back({.input = asset.input, .output = asset.output});
         }
     }
 
+    // A shard's manifest goes along with its output, for the merge to pick
+    // up. A full build's is kept for the next build to balance shards with.
+    const auto manifest_error = manifest.write_to_file(
+        options.shard ? out_path / neng::SHARD_MANIFEST_NAME : manifest_path);
+    if (manifest_error != Error::OK) {
+        std::cerr << "[ERROR]: Failed to write the build manifest: "
+                  << manifest_error << '\n';
+    }
+
+    if (options.archive_path) {
+        const auto archive_error = render_pages_to_archive(
+            pages, assets, document_config, options.pipeline,
+            *options.archive_path);
+        report_fragment_cache(fragment_cache);
+        return archive_error;
+    }
+
+    // The pages are handed out most expensive first, going by how long they
+    // took to render last time, so that the build does not end with every
+    // thread but one waiting on a big page that was picked up last. The
+    // archive keeps the pages in their listed order instead, so that it comes
+    // out the same every time.
+    const auto stats_path = build_cache_path(in_path, "stats");
+    auto [page_stats, stats_error] = neng::PageStats::from_file(stats_path);
+    const auto order = neng::longest_first(
+        neng::estimate_page_costs(manifest.pages, page_stats));
+
+    std::vector<Page> scheduled_pages;
+    std::vector<std::string_view> scheduled_inputs;
+    scheduled_pages.reserve(pages.size());
+    scheduled_inputs.reserve(pages.size());
+    for (const auto i : order) {
+        scheduled_pages.push_back(pages[i]);
+        scheduled_inputs.push_back(manifest.pages[i].input);
+    }
+
+    // The assets are mostly waiting on the disk, so they get copied on their
+    // own threads alongside the rendering.
+    std::thread asset_copier{[&]() {
+        neng::parallel_for(assets.size(), [&](size_t i) {
+            const auto &asset = assets[i];
+            const auto error = neng::copy_asset(
+                asset.input, out_path / asset.output, options.asset_copy_mode);
+            if (error != Error::OK) {
+                std::cerr << "[ERROR]: Failed to copy " << asset.input << ": "
+                          << error << '\n';
+            }
+        });
+    }};
+
+    neng::PipelineStats pipeline_stats;
+    const auto write_error = neng::run_render_pipeline(
+        scheduled_pages, document_config, options.pipeline,
+        [&](const Page &page, std::string_view html) {
+            std::ofstream out_file(out_path / page.output);
+            if (!out_file.is_open()) {
+                std::cerr << "[ERROR]: Failed to open "
+                          << out_path / page.output << '\n';
+                return Error::FILE_OPEN_ERROR;
+            }
+
+            out_file << html;
+            return Error::OK;
+        },
+        &pipeline_stats);
+
+    asset_copier.join();
+    report_fragment_cache(fragment_cache);
+    report_schedule(pipeline_stats,
+                    std::min(neng::worker_count(),
+                             options.pipeline.parse_workers +
+                                 options.pipeline.render_workers));
+
+    // Pages that failed took no time worth remembering, and pages that are
+    // gone are forgotten.
+    for (size_t i = 0; i < scheduled_pages.size(); i++) {
+        if (pipeline_stats.page_nanoseconds[i] > 0) {
+            page_stats.nanoseconds.insert_or_assign(
+                std::string{scheduled_inputs[i]},
+                pipeline_stats.page_nanoseconds[i]);
+        }
+    }
+
+    const std::unordered_set<std::string_view> existing_files(
+        page_files.begin(), page_files.end());
+    std::erase_if(page_stats.nanoseconds, [&](const auto &entry) {
+        return !existing_files.contains(entry.first);
+    });
+
+    if (page_stats.write_to_file(stats_path) != Error::OK) {
+        std::cerr << "[ERROR]: Failed to save " << stats_path << '\n';
+    }
+
+    if (write_error != Error::OK) {
+        return write_error;
+    }
+
     return Error::OK;
 }
 
@@ -120,10 +467,64 @@ Arguments:
 
     -c, --config <config file> Specifies the configuration file.
 
+    --output-archive <tar file> Writes everything that would have gone into
+                                the output directory into a single tar
+                                archive instead. Ending the name with .gz or
+                                .zst compresses it with gzip or zstd.
+
+    --link-assets Hardlinks the assets into the output directory instead of
+                  copying them.
+
+    --max-memory <size> Caps the memory held by the pages being worked on,
+                        like 512M or 2G. Reading pages pauses while the cap
+                        is reached. There is no cap by default.
+
+    --fragment-cache <size> Remembers the HTML of rendered paragraphs, up to
+                            the given size, like 64M, so that paragraphs
+                            repeated across many pages are only rendered
+                            once. Only used with --minify, since without it
+                            a paragraph is copied as it is, which is quicker
+                            than looking it up. The hits and misses are
+                            printed at the end.
+
+    --stage-workers <read>,<parse>,<render>,<write> Sets the number of threads
+                                                    for each stage of the
+                                                    rendering pipeline.
+
+    --minify Collapses the whitespace in the templates when they are loaded,
+             and in the paragraphs as they are rendered. The content of
+             <pre>, <textarea>, <script> and <style> is kept as it is. Same
+             as minify=true in the configuration.
+
+    --shard <i>/<N> Renders only the i-th of N shards of the pages, for
+                    splitting one build between machines. Pages are spread
+                    by size, according to the last full build's manifest in
+                    .neng-cache/manifest, or by a hash of their path. The
+                    assets only come out of shard 1.
+
+    --merge <shard output> Puts the outputs of all of the shards of a build
+                           together into the output directory, and saves
+                           their combined manifest in the input directory
+                           for the next sharded build. Given once per shard.
+
+    --batch [manifest] Renders every page listed in the manifest, or in the
+                       standard input if there is no manifest, with one
+                       input<TAB>output[<TAB>template] per line. Each line's
+                       outcome is printed as line<TAB>status<TAB>input.
+
+    --daemon <socket path> Keeps the configuration and template loaded and
+                           renders pages on request over a Unix domain
+                           socket, instead of rendering anything right away.
+                           Stops on SIGINT or SIGTERM, removing the socket.
+                           See render_daemon.hpp for the protocol.
+
 Defaults:
     input - ./
     output - ./out
-    template - ./template.html
+    template - ./template.html, or the one built in with
+               -DPROCESSOR_EMBED_TEMPLATE=<template file>, which is used
+               without reading or parsing anything. The daemon always reads
+               its template from a file.
     config - ./config.neng
 
 Document format:
@@ -139,6 +540,22 @@ Template format:
     anywhere in the template. May expand it later to include more features, but 
     so far, it's decent.
 
+    ${{asset css/site.css}} turns into the URL of a copy of pages/css/site.css
+    with a hash of its contents in the name, like
+    /pages/css/site.0123456789abcdef.css, so that it can be cached for good.
+    This only happens when rendering a directory; elsewhere the path is left
+    as it is.
+
+    When rendering a directory, a template.html placed in any subdirectory of
+    pages/ replaces the template for everything in that subdirectory. The
+    nearest one wins.
+
+Assets:
+
+    Every other file in pages/, like images, stylesheets and scripts, is
+    mirrored into the output directory as it is. Files that already have the
+    same size and modification time in the output are skipped.
+
 Configuration format:
 
     Very straightfoward. Here's an example configuration to show you what I mean.
@@ -146,17 +563,28 @@ Configuration format:
     title_class=title
     paragraph_class=paragraph
 
-    Yeah, those are the only two options here so far. Also, do not put spaces
-    between the equal signs. I cannot guarantee that it will work.
+    Yeah, those are the only two options here so far, besides minify=true,
+    which does the same as --minify. Also, do not put spaces between the
+    equal signs. I cannot guarantee that it will work.
 )help_text";
 } // namespace
 
 int main(int argc, char **argv) {
+    // A compressor behind --output-archive that dies early should surface as a
+    // write error instead of killing the whole process.
+    std::signal(SIGPIPE, SIG_IGN);
+
     fs::path target_path{"./"};
     fs::path output_path{"./out"};
 
     fs::path config_path{"./config.neng"};
-    fs::path template_path{"./template.html"};
+    std::optional<fs::path> template_path;
+
+    BuildOptions build_options;
+    std::optional<fs::path> daemon_socket_path;
+    bool batch_mode = false;
+    std::optional<fs::path> batch_manifest_path;
+    std::vector<fs::path> merge_paths;
 
     for (char **arg = argv + 1; arg < argv + argc; arg++) {
         std::string_view sw_arg{*arg};
@@ -173,6 +601,21 @@ int main(int argc, char **argv) {
             return EXIT_SUCCESS;
         }
 
+        if (sw_arg == "--batch") {
+            batch_mode = true;
+            continue;
+        }
+
+        if (sw_arg == "--link-assets") {
+            build_options.asset_copy_mode = neng::AssetCopyMode::HARDLINK;
+            continue;
+        }
+
+        if (sw_arg == "--minify") {
+            build_options.minify = true;
+            continue;
+        }
+
         if (arg > argv + 1) {
             std::string_view previous_arg{*(arg - 1)};
 
@@ -184,18 +627,150 @@ int main(int argc, char **argv) {
                 config_path = fs::path{*arg};
             } else if (previous_arg == "-t" || previous_arg == "--template") {
                 template_path = fs::path{*arg};
+            } else if (previous_arg == "--output-archive") {
+                build_options.archive_path = fs::path{*arg};
+            } else if (previous_arg == "--batch" && !sw_arg.starts_with('-')) {
+                batch_manifest_path = fs::path{*arg};
+            } else if (previous_arg == "--daemon") {
+                daemon_socket_path = fs::path{*arg};
+            } else if (previous_arg == "--shard") {
+                const auto [shard, error] = neng::parse_shard_spec(sw_arg);
+                if (error != Error::OK) {
+                    std::cerr << "[ERROR]: --shard takes the shard and the "
+                                 "number of shards, like 2/4.\n";
+                    return EXIT_FAILURE;
+                }
+                build_options.shard = shard;
+            } else if (previous_arg == "--merge") {
+                merge_paths.push_back(fs::path{*arg});
+            } else if (previous_arg == "--max-memory") {
+                const auto [max_memory, error] = neng::parse_byte_size(sw_arg);
+                if (error != Error::OK) {
+                    std::cerr << "[ERROR]: Invalid memory size '" << sw_arg
+                              << "'.\n";
+                    return EXIT_FAILURE;
+                }
+                build_options.pipeline.max_memory = max_memory;
+            } else if (previous_arg == "--fragment-cache") {
+                const auto [size, error] = neng::parse_byte_size(sw_arg);
+                if (error != Error::OK) {
+                    std::cerr << "[ERROR]: Invalid memory size '" << sw_arg
+                              << "'.\n";
+                    return EXIT_FAILURE;
+                }
+                build_options.fragment_cache_size = size;
+            } else if (previous_arg == "--stage-workers") {
+                const auto counts = neng::split_string(sw_arg, ",");
+                std::array<size_t, 4> workers{};
+                bool valid = counts.size() == workers.size();
+                for (size_t i = 0; valid && i < workers.size(); i++) {
+                    const auto &count = counts[i];
+                    const auto [end, error_code] = std::from_chars(
+                        count.data(), count.data() + count.size(), workers[i]);
+                    valid = error_code == std::errc{} &&
+                            end == count.data() + count.size() &&
+                            workers[i] > 0;
+                }
+
+                if (!valid) {
+                    std::cerr << "[ERROR]: --stage-workers takes four counts, "
+                                 "like 2,8,8,2.\n";
+                    return EXIT_FAILURE;
+                }
+
+                auto &pipeline = build_options.pipeline;
+                pipeline.read_workers = workers[0];
+                pipeline.parse_workers = workers[1];
+                pipeline.render_workers = workers[2];
+                pipeline.write_workers = workers[3];
+            }
+        }
+    }
+
+    if (!merge_paths.empty()) {
+        fs::create_directories(output_path);
+        const auto error = neng::merge_shards(
+            merge_paths, output_path, build_cache_path(target_path, "manifest"),
+            build_options.asset_copy_mode);
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to merge the shards: " << error
+                      << '\n';
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (build_options.shard && build_options.archive_path) {
+        std::cerr << "[ERROR]: --shard writes to a directory, so that the "
+                     "shards can be merged.\n";
+        return EXIT_FAILURE;
+    }
+
+    if (daemon_socket_path) {
+        static_assert(std::atomic<bool>::is_always_lock_free);
+        std::signal(SIGINT, stop_daemon);
+        std::signal(SIGTERM, stop_daemon);
+
+        const auto error = neng::run_daemon(
+            {
+                .socket_path = *daemon_socket_path,
+                .config_path = config_path,
+                .template_path =
+                    template_path.value_or(neng::DEFAULT_TEMPLATE_PATH),
+                .worker_count = neng::worker_count(),
+                .minify = build_options.minify,
+            },
+            daemon_stop);
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: The daemon failed: " << error << '\n';
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (batch_mode) {
+        auto [document_config, error] =
+            DocumentConfiguration::from_file(config_path.string());
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to parse the configuration: " << error
+                      << '\n';
+            return EXIT_FAILURE;
+        }
+        document_config.minify |= build_options.minify;
+
+        std::optional<neng::FragmentCache> fragment_cache;
+        attach_fragment_cache(build_options.fragment_cache_size,
+                              document_config, fragment_cache);
+
+        std::ifstream manifest_file;
+        if (batch_manifest_path) {
+            manifest_file.open(*batch_manifest_path);
+            if (!manifest_file.is_open()) {
+                std::cerr << "[ERROR]: Failed to open "
+                          << *batch_manifest_path << '\n';
+                return EXIT_FAILURE;
             }
         }
+
+        const auto result = neng::run_batch(
+            batch_manifest_path ? manifest_file : std::cin, document_config,
+            template_path, std::cout);
+        report_fragment_cache(fragment_cache);
+
+        return result == Error::OK ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     if (fs::is_directory(target_path)) {
-        if (!fs::is_directory(output_path)) {
+        if (!build_options.archive_path && !fs::is_directory(output_path)) {
             std::cerr << "[ERROR]: " << output_path << " is not a directory.\n";
             return EXIT_FAILURE;
         }
 
-        const auto result = render_directory(config_path, template_path,
-                                             target_path, output_path);
+        const auto result =
+            render_directory(config_path, template_path, target_path,
+                             output_path, build_options);
         if (result != Error::OK) {
             std::cerr << "[ERROR]: Failed to process the directory: " << result
                       << "\n";
@@ -206,23 +781,27 @@ int main(int argc, char **argv) {
             return EXIT_FAILURE;
         }
 
-        const auto [document_config, error] =
+        auto [document_config, error] =
             DocumentConfiguration::from_file(config_path.string());
         if (error != Error::OK) {
             std::cerr << "[ERROR]: Failed to parse the configuration: " << error
                       << '\n';
             return EXIT_FAILURE;
         }
+        document_config.minify |= build_options.minify;
 
-        const auto [document_template, error2] =
-            neng::DocumentTemplate::from_file(template_path);
+        auto [document_template, error2] = neng::load_template(template_path);
         if (error2 != Error::OK) {
-            std::cerr << "[ERROR]: Failed to parse the template: " << error
+            std::cerr << "[ERROR]: Failed to parse the template: " << error2
                       << '\n';
             return EXIT_FAILURE;
         }
 
-        const auto error3 = render_single_file(
+        if (document_config.minify) {
+            document_template.minify();
+        }
+
+        const auto error3 = neng::render_single_file(
             target_path, output_path, document_config, document_template);
         if (error3 != Error::OK) {
             std::cerr << "[ERROR]: Failed to render " << target_path << ": "
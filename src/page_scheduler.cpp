@@ -0,0 +1,118 @@
+#include "page_scheduler.hpp"
+#include "string_utils.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <numeric>
+
+namespace {
+bool parse_nanoseconds(std::string_view string, uint64_t &value) {
+    const auto [end, error_code] =
+        std::from_chars(string.data(), string.data() + string.size(), value);
+    return error_code == std::errc{} && end == string.data() + string.size();
+}
+} // namespace
+
+namespace neng {
+std::tuple<PageStats, Error>
+PageStats::from_file(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return {{}, Error::FILE_OPEN_ERROR};
+    }
+
+    PageStats stats;
+
+    std::string line;
+    uint32_t line_number = 1;
+    while (std::getline(file, line)) {
+        const auto parts = split_string(line, "\t");
+
+        uint64_t nanoseconds = 0;
+        if (parts.size() != 2 || !parse_nanoseconds(parts[1], nanoseconds)) {
+            std::cerr << "[ERROR]: " << path << ":" << line_number
+                      << ": Invalid syntax\n";
+            return {{}, Error::INVALID_SYNTAX};
+        }
+
+        stats.nanoseconds.insert_or_assign(std::string(parts[0]), nanoseconds);
+        line_number++;
+    }
+
+    return {std::move(stats), Error::OK};
+}
+
+Error PageStats::write_to_file(const std::filesystem::path &path) const {
+    std::vector<std::pair<std::string_view, uint64_t>> sorted_pages(
+        nanoseconds.begin(), nanoseconds.end());
+    std::sort(sorted_pages.begin(), sorted_pages.end());
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    for (const auto &[input, page_nanoseconds] : sorted_pages) {
+        file << input << '\t' << page_nanoseconds << '\n';
+    }
+
+    return file ? Error::OK : Error::FILE_WRITE_ERROR;
+}
+
+std::vector<uint64_t> estimate_page_costs(const std::vector<ManifestPage> &pages,
+                                          const PageStats &stats) {
+    std::vector<uint64_t> costs(pages.size(), 0);
+    std::vector<bool> timed(pages.size(), false);
+
+    uint64_t timed_nanoseconds = 0;
+    uint64_t timed_bytes = 0;
+
+    for (size_t i = 0; i < pages.size(); i++) {
+        const auto found = stats.nanoseconds.find(pages[i].input);
+        if (found != stats.nanoseconds.end()) {
+            costs[i] = found->second;
+            timed[i] = true;
+            timed_nanoseconds += found->second;
+            timed_bytes += pages[i].size;
+        }
+    }
+
+    const auto nanoseconds_per_byte =
+        timed_bytes == 0 ? 1.0
+                         : static_cast<double>(timed_nanoseconds) /
+                               static_cast<double>(timed_bytes);
+
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (!timed[i]) {
+            costs[i] = static_cast<uint64_t>(
+                static_cast<double>(pages[i].size) * nanoseconds_per_byte);
+        }
+    }
+
+    return costs;
+}
+
+std::vector<size_t> longest_first(const std::vector<uint64_t> &costs) {
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return costs[a] > costs[b];
+    });
+
+    return order;
+}
+
+uint64_t makespan_lower_bound(const std::vector<uint64_t> &costs,
+                              size_t workers) {
+    if (costs.empty()) {
+        return 0;
+    }
+
+    const auto total = std::accumulate(costs.begin(), costs.end(), uint64_t{0});
+    const auto longest = *std::max_element(costs.begin(), costs.end());
+    workers = std::max<size_t>(workers, 1);
+
+    return std::max(longest, (total + workers - 1) / workers);
+}
+} // namespace neng
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "build_manifest.hpp"
+
+namespace neng {
+// How long each page took to parse and render the last time it was built, by
+// its path relative to the pages directory. One input<TAB>nanoseconds per
+// line, kept in .neng-cache/stats.
+struct PageStats {
+    std::unordered_map<std::string, uint64_t> nanoseconds;
+
+    static std::tuple<PageStats, Error>
+    from_file(const std::filesystem::path &path);
+
+    // Writes the pages sorted by input.
+    Error write_to_file(const std::filesystem::path &path) const;
+};
+
+// What each page is expected to cost to render. A page that was timed before
+// costs what it took then. Any other page goes by the size of its source,
+// turned into time at the rate of the pages that were timed, or simply counts
+// its bytes if none were.
+std::vector<uint64_t> estimate_page_costs(const std::vector<ManifestPage> &pages,
+                                          const PageStats &stats);
+
+// The order to hand out pages in, most expensive first, so that no big page
+// gets picked up at the very end and leaves every other thread waiting on it.
+// Ties keep their original order.
+std::vector<size_t> longest_first(const std::vector<uint64_t> &costs);
+
+// No schedule of these costs on `workers` threads can finish any sooner: the
+// work has to be shared out, and the biggest piece cannot be.
+uint64_t makespan_lower_bound(const std::vector<uint64_t> &costs,
+                              size_t workers);
+} // namespace neng
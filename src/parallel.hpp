@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+namespace neng {
+inline size_t worker_count() {
+    const auto count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+// Calls `function(i)` for every i in [0, count) across a pool of threads. The
+// indices are handed out one at a time, so uneven work balances itself out.
+template <typename F>
+void parallel_for(size_t count, F &&function,
+                  size_t thread_count = worker_count()) {
+    std::atomic<size_t> next_index{0};
+
+    const auto work = [&]() {
+        for (auto i = next_index.fetch_add(1); i < count;
+             i = next_index.fetch_add(1)) {
+            function(i);
+        }
+    };
+
+    thread_count = std::min(thread_count, count);
+    if (thread_count <= 1) {
+        work();
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; i++) {
+        threads.emplace_back(work);
+    }
+
+    work();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+} // namespace neng
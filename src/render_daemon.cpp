@@ -0,0 +1,598 @@
+#include "render_daemon.hpp"
+#include "document_template.hpp"
+#include "incremental_document.hpp"
+#include "input_normalizer.hpp"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+using neng::DocumentConfiguration;
+using neng::DocumentTemplate;
+using neng::Error;
+
+// Requests larger than this are refused rather than buffered.
+constexpr uint32_t MAX_MESSAGE_SIZE = 256 * 1024 * 1024;
+
+bool read_exactly(int fd, char *buffer, size_t size) {
+    while (size > 0) {
+        const auto result = read(fd, buffer, size);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        buffer += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+bool write_exactly(int fd, const char *buffer, size_t size) {
+    while (size > 0) {
+        const auto result = send(fd, buffer, size, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        buffer += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+bool read_message(int fd, std::string &message) {
+    unsigned char length_bytes[4];
+    if (!read_exactly(fd, reinterpret_cast<char *>(length_bytes), 4)) {
+        return false;
+    }
+
+    const uint32_t length = (uint32_t{length_bytes[0]} << 24) |
+                            (uint32_t{length_bytes[1]} << 16) |
+                            (uint32_t{length_bytes[2]} << 8) |
+                            uint32_t{length_bytes[3]};
+    if (length > MAX_MESSAGE_SIZE) {
+        return false;
+    }
+
+    message.resize(length);
+    return read_exactly(fd, message.data(), length);
+}
+
+bool write_message(int fd, std::string_view message) {
+    const auto length = static_cast<uint32_t>(message.size());
+    const char length_bytes[4] = {
+        static_cast<char>(length >> 24),
+        static_cast<char>(length >> 16),
+        static_cast<char>(length >> 8),
+        static_cast<char>(length),
+    };
+
+    return write_exactly(fd, length_bytes, 4) &&
+           write_exactly(fd, message.data(), message.size());
+}
+
+int64_t modification_time(const fs::path &path) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return -1;
+    }
+
+    return file_stat.st_mtim.tv_sec * 1'000'000'000 + file_stat.st_mtim.tv_nsec;
+}
+
+// The configuration and template, as loaded at one point in time. Requests
+// hold on to the snapshot they started with, so a reload never pulls anything
+// out from under them.
+struct Snapshot {
+    DocumentConfiguration document_config;
+    DocumentTemplate document_template;
+    int64_t config_time;
+    int64_t template_time;
+};
+
+class SnapshotHolder {
+  public:
+    explicit SnapshotHolder(const neng::DaemonOptions &options)
+        : options{options} {}
+
+    // Returns the current snapshot, reloading it first if either file has
+    // changed since. If the reload fails, the old snapshot is kept.
+    std::tuple<std::shared_ptr<const Snapshot>, Error> get() {
+        const auto config_time = modification_time(options.config_path);
+        const auto template_time = modification_time(options.template_path);
+
+        std::lock_guard lock{mutex};
+        if (snapshot && snapshot->config_time == config_time &&
+            snapshot->template_time == template_time) {
+            return {snapshot, Error::OK};
+        }
+
+        auto [document_config, error] =
+            DocumentConfiguration::from_file(options.config_path.string());
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to load " << options.config_path
+                      << ": " << error << '\n';
+            return {snapshot, snapshot ? Error::OK : error};
+        }
+
+        auto [document_template, error2] =
+            DocumentTemplate::from_file(options.template_path);
+        if (error2 != Error::OK) {
+            std::cerr << "[ERROR]: Failed to load " << options.template_path
+                      << ": " << error2 << '\n';
+            return {snapshot, snapshot ? Error::OK : error2};
+        }
+
+        document_config.minify |= options.minify;
+        if (document_config.minify) {
+            document_template.minify();
+        }
+
+        if (snapshot) {
+            std::cerr << "[INFO]: Reloaded the configuration and template.\n";
+        }
+
+        snapshot = std::make_shared<const Snapshot>(Snapshot{
+            .document_config = std::move(document_config),
+            .document_template = std::move(document_template),
+            .config_time = config_time,
+            .template_time = template_time,
+        });
+
+        return {snapshot, Error::OK};
+    }
+
+  private:
+    const neng::DaemonOptions &options;
+    std::mutex mutex;
+    std::shared_ptr<const Snapshot> snapshot;
+};
+
+// The last parse of every file that was rendered, so that saving a small edit
+// to a long page only re-renders the part of it that changed.
+class DocumentCache {
+  public:
+    struct Entry {
+        std::mutex mutex;
+        std::optional<neng::IncrementalDocument> document;
+    };
+
+    std::shared_ptr<Entry> get(const std::string &path) {
+        std::lock_guard lock{mutex};
+        if (entries.size() >= MAX_ENTRIES && !entries.contains(path)) {
+            // Plenty for editing sessions; rather than tracking what is least
+            // recently used, just start over.
+            entries.clear();
+        }
+
+        auto &entry = entries[path];
+        if (!entry) {
+            entry = std::make_shared<Entry>();
+        }
+
+        return entry;
+    }
+
+  private:
+    static constexpr size_t MAX_ENTRIES = 1024;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+};
+
+std::tuple<std::string, Error> handle_request(std::string_view request,
+                                              SnapshotHolder &snapshots,
+                                              DocumentCache &documents) {
+    if (request.empty()) {
+        return {"Empty request", Error::INVALID_SYNTAX};
+    }
+
+    const auto kind = static_cast<neng::RenderRequestKind>(request[0]);
+    const auto payload = request.substr(1);
+
+    const auto [snapshot, error] = snapshots.get();
+    if (error != Error::OK) {
+        return {"The configuration or template failed to load", error};
+    }
+
+    const auto &document_config = snapshot->document_config;
+    const auto &document_template = snapshot->document_template;
+
+    switch (kind) {
+    case neng::RenderRequestKind::FILE: {
+        auto [source, file_error] = neng::read_input(fs::path{payload});
+        if (file_error != Error::OK) {
+            return {"Failed to read " + std::string(payload), file_error};
+        }
+
+        const auto entry = documents.get(std::string(payload));
+        std::lock_guard lock{entry->mutex};
+        if (entry->document) {
+            entry->document->update(std::move(source), document_config);
+        } else {
+            entry->document = neng::IncrementalDocument::parse(
+                std::move(source), document_config);
+        }
+
+        return {document_template.render_to_string(
+                    entry->document->get_title(),
+                    entry->document->render_html()),
+                Error::OK};
+    }
+    case neng::RenderRequestKind::MARKDOWN: {
+        std::string source{payload};
+        const auto [position, input_error] = neng::normalize_input(source);
+        if (input_error != Error::OK) {
+            return {"Invalid UTF-8 at " + std::to_string(position.line) + ":" +
+                        std::to_string(position.column),
+                    input_error};
+        }
+
+        const auto document = neng::Document::parse_document(source);
+        const auto body = document_config.render_html_to_string(document);
+        return {document_template.render_to_string(document.get_title(), body),
+                Error::OK};
+    }
+    }
+
+    return {"Unknown request kind", Error::INVALID_SYNTAX};
+}
+
+// Serves the next request on a connection whose request has started to
+// arrive. Returns false once the connection is done with, either because the
+// client hung up or because something went wrong with it.
+bool serve_request(int connection_fd, SnapshotHolder &snapshots,
+                   DocumentCache &documents) {
+    std::string request;
+    if (!read_message(connection_fd, request)) {
+        return false;
+    }
+
+    auto [body, error] = handle_request(request, snapshots, documents);
+
+    std::string response;
+    response.push_back(static_cast<char>(error));
+    response += body;
+
+    return write_message(connection_fd, response);
+}
+
+// Connections with a request waiting, handed from the thread that polls them
+// to whichever worker is free.
+class ConnectionQueue {
+  public:
+    void push(int connection_fd) {
+        {
+            std::lock_guard lock{mutex};
+            connections.push_back(connection_fd);
+        }
+        ready.notify_one();
+    }
+
+    // Waits for the next connection. Returns -1 once the queue is closed.
+    int pop() {
+        std::unique_lock lock{mutex};
+        ready.wait(lock, [&] { return closed || !connections.empty(); });
+        if (connections.empty()) {
+            return -1;
+        }
+
+        const auto connection_fd = connections.front();
+        connections.pop_front();
+        return connection_fd;
+    }
+
+    // Wakes up the workers for good. Returns the connections that were never
+    // picked up.
+    std::deque<int> close() {
+        std::lock_guard lock{mutex};
+        closed = true;
+        ready.notify_all();
+        return std::move(connections);
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> connections;
+    bool closed{false};
+};
+
+// Connections that a worker is done serving a request on, on their way back
+// to the polling thread. Pushing one wakes that thread up.
+class ReturnedConnections {
+  public:
+    ReturnedConnections() {
+        if (pipe2(wake_fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+            wake_fds[0] = wake_fds[1] = -1;
+        }
+    }
+
+    ~ReturnedConnections() {
+        close(wake_fds[0]);
+        close(wake_fds[1]);
+    }
+
+    bool is_open() const { return wake_fds[0] >= 0; }
+
+    // Readable whenever there are connections to take.
+    int wake_fd() const { return wake_fds[0]; }
+
+    void push(int connection_fd) {
+        {
+            std::lock_guard lock{mutex};
+            connections.push_back(connection_fd);
+        }
+
+        // A full pipe already has the polling thread on its way.
+        const char byte = 0;
+        [[maybe_unused]] const auto result = write(wake_fds[1], &byte, 1);
+    }
+
+    std::vector<int> take() {
+        char bytes[64];
+        while (read(wake_fds[0], bytes, sizeof(bytes)) > 0) {
+        }
+
+        std::lock_guard lock{mutex};
+        return std::move(connections);
+    }
+
+  private:
+    int wake_fds[2];
+    std::mutex mutex;
+    std::vector<int> connections;
+};
+
+std::tuple<int, Error> open_socket(const fs::path &socket_path,
+                                   sockaddr_un &address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.native().size() >= sizeof(address.sun_path)) {
+        std::cerr << "[ERROR]: The socket path " << socket_path
+                  << " is too long.\n";
+        return {-1, Error::FILE_OPEN_ERROR};
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return {-1, Error::FILE_OPEN_ERROR};
+    }
+
+    return {fd, Error::OK};
+}
+
+// Makes way for binding to `socket_path`, which fails if anything is there.
+// Only a socket that no daemon answers on anymore is removed; anything else
+// is left alone and the daemon refuses to start.
+Error remove_stale_socket(const fs::path &socket_path,
+                          const sockaddr_un &address) {
+    struct stat socket_stat;
+    if (lstat(socket_path.c_str(), &socket_stat) != 0) {
+        if (errno == ENOENT) {
+            return Error::OK;
+        }
+
+        std::cerr << "[ERROR]: Failed to check " << socket_path << ": "
+                  << std::strerror(errno) << '\n';
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    if (!S_ISSOCK(socket_stat.st_mode)) {
+        std::cerr << "[ERROR]: " << socket_path
+                  << " already exists and is not a socket.\n";
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    const int probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool in_use =
+        probe_fd >= 0 && connect(probe_fd,
+                                 reinterpret_cast<const sockaddr *>(&address),
+                                 sizeof(address)) == 0;
+    if (probe_fd >= 0) {
+        close(probe_fd);
+    }
+    if (in_use) {
+        std::cerr << "[ERROR]: Another daemon is already listening on "
+                  << socket_path << ".\n";
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    if (unlink(socket_path.c_str()) != 0) {
+        std::cerr << "[ERROR]: Failed to remove the old socket " << socket_path
+                  << ": " << std::strerror(errno) << '\n';
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    return Error::OK;
+}
+} // namespace
+
+namespace neng {
+Error run_daemon(const DaemonOptions &options, const std::atomic<bool> &stop) {
+    SnapshotHolder snapshots{options};
+    DocumentCache documents;
+
+    // Load everything up front, so that mistakes show up right away instead
+    // of on the first request.
+    const auto [snapshot, error] = snapshots.get();
+    if (error != Error::OK) {
+        return error;
+    }
+
+    sockaddr_un address;
+    const auto [listen_fd, error2] = open_socket(options.socket_path, address);
+    if (error2 != Error::OK) {
+        return error2;
+    }
+
+    const auto error3 = remove_stale_socket(options.socket_path, address);
+    if (error3 != Error::OK) {
+        close(listen_fd);
+        return error3;
+    }
+
+    struct stat socket_stat;
+    if (bind(listen_fd, reinterpret_cast<const sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0 ||
+        lstat(options.socket_path.c_str(), &socket_stat) != 0) {
+        std::cerr << "[ERROR]: Failed to listen on " << options.socket_path
+                  << ": " << std::strerror(errno) << '\n';
+        close(listen_fd);
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    ReturnedConnections returned;
+    if (!returned.is_open()) {
+        close(listen_fd);
+        unlink(options.socket_path.c_str());
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    std::cerr << "[INFO]: Listening on " << options.socket_path << '\n';
+
+    // Workers only ever hold a connection for a single request, so any number
+    // of idle clients can stay connected without keeping the others waiting.
+    ConnectionQueue pending;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::max<size_t>(options.worker_count, 1); i++) {
+        workers.emplace_back([&]() {
+            for (int connection_fd; (connection_fd = pending.pop()) >= 0;) {
+                if (serve_request(connection_fd, snapshots, documents)) {
+                    returned.push(connection_fd);
+                } else {
+                    close(connection_fd);
+                }
+            }
+        });
+    }
+
+    // The listening socket and the wake-up pipe come first, followed by the
+    // connections that are waiting for their next request. The timeout is
+    // there to notice `stop`.
+    std::vector<pollfd> poll_fds{
+        {.fd = listen_fd, .events = POLLIN, .revents = 0},
+        {.fd = returned.wake_fd(), .events = POLLIN, .revents = 0},
+    };
+    while (!stop.load()) {
+        if (poll(poll_fds.data(), poll_fds.size(), 200) <= 0) {
+            continue;
+        }
+
+        std::vector<pollfd> idle;
+        for (size_t i = 2; i < poll_fds.size(); i++) {
+            if (poll_fds[i].revents != 0) {
+                pending.push(poll_fds[i].fd);
+            } else {
+                idle.push_back(poll_fds[i]);
+            }
+        }
+
+        if (poll_fds[0].revents != 0) {
+            for (int connection_fd;
+                 (connection_fd = accept4(listen_fd, nullptr, nullptr,
+                                          SOCK_CLOEXEC)) >= 0;) {
+                // A client that stalls halfway through a request gives up its
+                // worker after a while.
+                const timeval timeout{.tv_sec = 10, .tv_usec = 0};
+                setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout));
+                idle.push_back(
+                    {.fd = connection_fd, .events = POLLIN, .revents = 0});
+            }
+        }
+
+        if (poll_fds[1].revents != 0) {
+            for (const auto connection_fd : returned.take()) {
+                idle.push_back(
+                    {.fd = connection_fd, .events = POLLIN, .revents = 0});
+            }
+        }
+
+        poll_fds.resize(2);
+        poll_fds.insert(poll_fds.end(), idle.begin(), idle.end());
+    }
+
+    // Requests already being served are finished, the rest are dropped.
+    for (const auto connection_fd : pending.close()) {
+        close(connection_fd);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    for (size_t i = 2; i < poll_fds.size(); i++) {
+        close(poll_fds[i].fd);
+    }
+    for (const auto connection_fd : returned.take()) {
+        close(connection_fd);
+    }
+
+    close(listen_fd);
+
+    // Unless another daemon has taken the path over in the meantime.
+    struct stat current_stat;
+    if (lstat(options.socket_path.c_str(), &current_stat) == 0 &&
+        current_stat.st_dev == socket_stat.st_dev &&
+        current_stat.st_ino == socket_stat.st_ino) {
+        unlink(options.socket_path.c_str());
+    }
+
+    return Error::OK;
+}
+
+std::tuple<std::string, Error> request_render(const fs::path &socket_path,
+                                              RenderRequestKind kind,
+                                              std::string_view payload) {
+    sockaddr_un address;
+    const auto [fd, error] = open_socket(socket_path, address);
+    if (error != Error::OK) {
+        return {"", error};
+    }
+
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&address),
+                sizeof(address)) != 0) {
+        close(fd);
+        return {"", Error::FILE_OPEN_ERROR};
+    }
+
+    std::string request;
+    request.push_back(static_cast<char>(kind));
+    request += payload;
+
+    std::string response;
+    const bool exchanged =
+        write_message(fd, request) && read_message(fd, response);
+    close(fd);
+
+    if (!exchanged || response.empty()) {
+        return {"", Error::FILE_READ_ERROR};
+    }
+
+    return {response.substr(1), static_cast<Error>(response[0])};
+}
+} // namespace neng
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "document.hpp"
+
+#include <atomic>
+
+namespace neng {
+// The daemon speaks a small length-prefixed protocol over a Unix domain
+// socket. Every message is a 4-byte big-endian length followed by that many
+// bytes. A request's bytes start with a kind:
+//
+//     'F' <path to a Markdown file>
+//     'M' <Markdown source>
+//
+// and the response's bytes are a 1-byte Error code followed by either the
+// rendered HTML (for Error::OK) or a description of what went wrong. A
+// connection may carry any number of requests, one after another.
+enum class RenderRequestKind : char {
+    FILE = 'F',
+    MARKDOWN = 'M',
+};
+
+struct DaemonOptions {
+    std::filesystem::path socket_path;
+    std::filesystem::path config_path;
+    std::filesystem::path template_path;
+    size_t worker_count;
+    // Minifies the output, on top of whatever the configuration says.
+    bool minify{false};
+};
+
+// Keeps the configuration and template loaded and serves render requests
+// until `stop` becomes true, then removes the socket. The calling thread
+// accepts connections and watches them for requests, which it hands to the
+// worker threads one at a time. The configuration and template are reloaded
+// whenever their modification times change.
+//
+// A socket left at `socket_path` by a daemon that is gone is replaced. The
+// daemon refuses to start if anything else is there, or another daemon is
+// still listening on it.
+Error run_daemon(const DaemonOptions &options,
+                 const std::atomic<bool> &stop = std::atomic<bool>{false});
+
+// Sends a single request to a daemon and waits for the response. The error is
+// either a transport error or the status that the daemon sent back.
+std::tuple<std::string, Error>
+request_render(const std::filesystem::path &socket_path,
+               RenderRequestKind kind, std::string_view payload);
+} // namespace neng
@@ -0,0 +1,431 @@
+#include "render_pipeline.hpp"
+#include "bounded_queue.hpp"
+#include "flat_document.hpp"
+#include "input_normalizer.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <time.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+using neng::BoundedQueue;
+using neng::FlatDocument;
+using neng::Error;
+using neng::Page;
+
+struct Job {
+    std::string source;
+    FlatDocument document;
+    std::string html;
+    Error error{Error::OK};
+    // What the job currently counts for against the memory budget.
+    size_t bytes{0};
+    // CPU time spent parsing and rendering.
+    uint64_t nanoseconds{0};
+    // The most threads that parsing or rendering was split across.
+    size_t threads{1};
+    // When parsing started and rendering ended, if the page got that far.
+    std::chrono::steady_clock::time_point parse_start;
+    std::chrono::steady_clock::time_point render_end;
+};
+
+uint64_t thread_cpu_nanoseconds() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+}
+
+// Runs `function` and adds the CPU time it took to `nanoseconds`. The stages
+// have more threads between them than there are cores, so the time on the
+// clock would also count however long the thread sat waiting for a core.
+template <typename F> void timed(uint64_t &nanoseconds, F &&function) {
+    const auto start = thread_cpu_nanoseconds();
+    function();
+    nanoseconds += thread_cpu_nanoseconds() - start;
+}
+
+size_t document_bytes(const FlatDocument &document) {
+    return document.types.capacity() * sizeof(neng::ParagraphType) +
+           document.header_levels.capacity() +
+           document.offsets.capacity() * sizeof(uint32_t) +
+           document.lengths.capacity() * sizeof(uint32_t) +
+           document.text.capacity();
+}
+
+// Tracks the bytes held by the pages in flight. Anything that might let a
+// waiting reader through bumps `changes`, which is what readers sleep on.
+class MemoryBudget {
+  public:
+    explicit MemoryBudget(size_t limit) : limit{limit} {}
+
+    // Waits until `bytes` more fit in the budget. A reader is always let
+    // through when nothing else is in flight, or when `admit_anyway` says so,
+    // so that a single page bigger than the budget still gets rendered.
+    template <typename F> void acquire(size_t bytes, F &&admit_anyway) {
+        for (;;) {
+            const auto seen_changes = changes.load();
+            auto current = in_flight.load();
+
+            if (limit == 0 || current == 0 || current + bytes <= limit ||
+                admit_anyway()) {
+                if (in_flight.compare_exchange_weak(current, current + bytes)) {
+                    return;
+                }
+                continue;
+            }
+
+            changes.wait(seen_changes);
+        }
+    }
+
+    void resize(size_t &bytes, size_t new_bytes) {
+        if (new_bytes > bytes) {
+            in_flight.fetch_add(new_bytes - bytes);
+        } else {
+            in_flight.fetch_sub(bytes - new_bytes);
+            notify();
+        }
+        bytes = new_bytes;
+    }
+
+    void notify() {
+        changes.fetch_add(1);
+        changes.notify_all();
+    }
+
+  private:
+    size_t limit;
+    std::atomic<size_t> in_flight{0};
+    std::atomic<uint32_t> changes{0};
+};
+
+// The cores that the parse and render workers leave idle, lent out to big
+// pages. A worker holds on to one core while it works on a page, and a page
+// with more than one chunk borrows as many of the idle ones as it has chunks
+// for. Towards the end of a build, when most workers have run out of pages, a
+// big page left over is spread across every core instead of just its own.
+class CoreBudget {
+  public:
+    explicit CoreBudget(size_t cores) : idle{static_cast<ptrdiff_t>(cores)} {}
+
+    // Takes the worker's own core and up to `chunks - 1` idle ones. Returns
+    // how many threads the page may be split across.
+    size_t acquire(size_t chunks) {
+        // With more workers than cores, this can go below zero, in which case
+        // there is nothing to borrow until enough of them are done.
+        auto available = idle.fetch_sub(1) - 1;
+
+        ptrdiff_t borrowed = 0;
+        while (chunks > 1 && available > 0) {
+            borrowed =
+                std::min(available, static_cast<ptrdiff_t>(chunks - 1));
+            if (idle.compare_exchange_weak(available, available - borrowed)) {
+                break;
+            }
+            borrowed = 0;
+        }
+
+        return 1 + borrowed;
+    }
+
+    void release(size_t threads) {
+        idle.fetch_add(static_cast<ptrdiff_t>(threads));
+    }
+
+  private:
+    std::atomic<ptrdiff_t> idle;
+};
+
+// How many chunks of PARALLEL_CHUNK_SIZE bytes parse_parallel and
+// render_html_to_string_parallel cut `bytes` into, give or take.
+size_t chunk_count(size_t bytes) {
+    return std::max<size_t>(bytes / neng::PARALLEL_CHUNK_SIZE, 1);
+}
+
+template <typename F>
+void spawn_workers(std::vector<std::thread> &threads, size_t count,
+                   F &&work) {
+    for (size_t i = 0; i < count; i++) {
+        threads.emplace_back(work);
+    }
+}
+} // namespace
+
+namespace neng {
+Error run_render_pipeline(const std::vector<Page> &pages,
+                          const DocumentConfiguration &document_config,
+                          const PipelineOptions &options,
+                          const PageWriter &write_page,
+                          PipelineStats *stats) {
+    std::vector<Job> jobs(pages.size());
+    MemoryBudget budget{options.max_memory};
+
+    const auto read_workers = std::max<size_t>(options.read_workers, 1);
+    const auto parse_workers = std::max<size_t>(options.parse_workers, 1);
+    const auto render_workers = std::max<size_t>(options.render_workers, 1);
+    const auto write_workers =
+        options.ordered_output ? 1 : std::max<size_t>(options.write_workers, 1);
+
+    // parse_parallel and render_html_to_string_parallel start threads of their
+    // own for every big page, which must not add up to more than the cores.
+    CoreBudget cores{std::max<size_t>(options.cores, 1)};
+
+    const auto queue_size = [](size_t consumers) {
+        return std::max<size_t>(consumers * 2, 16);
+    };
+
+    BoundedQueue<size_t> read_queue{queue_size(parse_workers)};
+    BoundedQueue<size_t> parse_queue{queue_size(render_workers)};
+    BoundedQueue<size_t> render_queue{queue_size(write_workers)};
+
+    for (size_t i = 0; i < read_workers; i++) {
+        read_queue.add_producer();
+    }
+    for (size_t i = 0; i < parse_workers; i++) {
+        parse_queue.add_producer();
+    }
+    for (size_t i = 0; i < render_workers; i++) {
+        render_queue.add_producer();
+    }
+
+    // In ordered mode, the writer holds on to pages that arrive early, so the
+    // page it is waiting for has to get past the budget no matter what, and
+    // reading too far ahead of it is pointless.
+    std::atomic<size_t> next_to_read{0};
+    std::atomic<size_t> next_to_write{0};
+    const size_t ordered_window = worker_count() * 4;
+
+    std::vector<std::thread> threads;
+
+    spawn_workers(threads, read_workers, [&]() {
+        for (auto i = next_to_read.fetch_add(1); i < pages.size();
+             i = next_to_read.fetch_add(1)) {
+            auto &job = jobs[i];
+
+            std::error_code error_code;
+            const auto file_size = fs::file_size(pages[i].input, error_code);
+
+            if (options.ordered_output) {
+                for (auto written = next_to_write.load();
+                     i >= written + ordered_window;
+                     written = next_to_write.load()) {
+                    next_to_write.wait(written);
+                }
+            }
+
+            budget.acquire(error_code ? 0 : file_size, [&]() {
+                return options.ordered_output && i == next_to_write.load();
+            });
+            job.bytes = error_code ? 0 : file_size;
+
+            auto [source, error] = read_input(pages[i].input);
+            job.source = std::move(source);
+            job.error = error;
+            budget.resize(job.bytes, job.source.capacity());
+
+            read_queue.push(i);
+        }
+
+        read_queue.remove_producer();
+    });
+
+    spawn_workers(threads, parse_workers, [&]() {
+        size_t i;
+        while (read_queue.pop(i)) {
+            auto &job = jobs[i];
+            if (job.error == Error::OK) {
+                const auto threads =
+                    cores.acquire(chunk_count(job.source.size()));
+                job.threads = std::max(job.threads, threads);
+
+                job.parse_start = std::chrono::steady_clock::now();
+                timed(job.nanoseconds, [&]() {
+                    job.document =
+                        FlatDocument::parse_parallel(job.source, threads);
+                });
+                cores.release(threads);
+            }
+
+            job.source = {};
+            budget.resize(job.bytes, document_bytes(job.document));
+
+            parse_queue.push(i);
+        }
+
+        parse_queue.remove_producer();
+    });
+
+    spawn_workers(threads, render_workers, [&]() {
+        size_t i;
+        while (parse_queue.pop(i)) {
+            auto &job = jobs[i];
+            if (job.error == Error::OK) {
+                const auto threads =
+                    cores.acquire(chunk_count(job.document.text.size()));
+                job.threads = std::max(job.threads, threads);
+
+                timed(job.nanoseconds, [&]() {
+                    const auto body =
+                        document_config.render_html_to_string_parallel(
+                            job.document, threads);
+                    job.html = pages[i].document_template->render_to_string(
+                        job.document.get_title(), body);
+                });
+                job.render_end = std::chrono::steady_clock::now();
+                cores.release(threads);
+            }
+
+            job.document = {};
+            budget.resize(job.bytes, job.html.capacity());
+
+            render_queue.push(i);
+        }
+
+        render_queue.remove_producer();
+    });
+
+    std::mutex write_error_mutex;
+    auto write_error = Error::OK;
+
+    const auto finish_job = [&](size_t i) {
+        auto &job = jobs[i];
+        if (job.error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to render " << pages[i].input << ": "
+                      << job.error << '\n';
+        } else {
+            const auto error = write_page(pages[i], job.html);
+            if (error != Error::OK) {
+                std::lock_guard lock{write_error_mutex};
+                if (write_error == Error::OK) {
+                    write_error = error;
+                }
+            }
+        }
+
+        job.html = {};
+        budget.resize(job.bytes, 0);
+    };
+
+    spawn_workers(threads, write_workers, [&]() {
+        if (!options.ordered_output) {
+            size_t i;
+            while (render_queue.pop(i)) {
+                finish_job(i);
+            }
+            return;
+        }
+
+        std::vector<bool> arrived(pages.size(), false);
+        size_t i;
+        while (render_queue.pop(i)) {
+            arrived[i] = true;
+
+            auto next = next_to_write.load();
+            while (next < pages.size() && arrived[next]) {
+                finish_job(next);
+                next++;
+                next_to_write.store(next);
+                next_to_write.notify_all();
+                budget.notify();
+            }
+        }
+    });
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    if (stats) {
+        stats->page_nanoseconds.clear();
+        stats->page_threads.clear();
+        stats->render_span_nanoseconds = 0;
+
+        std::optional<std::chrono::steady_clock::time_point> first_start;
+        std::chrono::steady_clock::time_point last_end;
+        for (const auto &job : jobs) {
+            stats->page_nanoseconds.push_back(job.nanoseconds);
+            stats->page_threads.push_back(job.threads);
+            if (job.render_end == std::chrono::steady_clock::time_point{}) {
+                continue;
+            }
+
+            first_start = std::min(first_start.value_or(job.parse_start),
+                                   job.parse_start);
+            last_end = std::max(last_end, job.render_end);
+        }
+
+        if (first_start) {
+            stats->render_span_nanoseconds =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    last_end - *first_start)
+                    .count();
+        }
+    }
+
+    return write_error;
+}
+
+std::tuple<size_t, Error> parse_byte_size(std::string_view string) {
+    size_t value = 0;
+    const auto [end, error_code] =
+        std::from_chars(string.data(), string.data() + string.size(), value);
+    if (error_code != std::errc{} || end == string.data()) {
+        return {0, Error::INVALID_SYNTAX};
+    }
+
+    const std::string_view suffix{end, string.data() + string.size()};
+    if (suffix.empty() || suffix == "B") {
+        return {value, Error::OK};
+    } else if (suffix == "K" || suffix == "KB") {
+        return {value << 10, Error::OK};
+    } else if (suffix == "M" || suffix == "MB") {
+        return {value << 20, Error::OK};
+    } else if (suffix == "G" || suffix == "GB") {
+        return {value << 30, Error::OK};
+    }
+
+    return {0, Error::INVALID_SYNTAX};
+}
+
+std::tuple<std::string, Error>
+render_page(const fs::path &in_path,
+            const DocumentConfiguration &document_config,
+            const DocumentTemplate &document_template) {
+    const auto [source, error] = read_input(in_path);
+    if (error != Error::OK) {
+        return {"", error};
+    }
+
+    const auto document = FlatDocument::parse_parallel(source);
+
+    const auto rendered_result =
+        document_config.render_html_to_string_parallel(document);
+    const auto slotted_result = document_template.render_to_string(
+        document.get_title(), rendered_result);
+
+    return {slotted_result, Error::OK};
+}
+
+Error render_single_file(const fs::path &in_path, const fs::path &out_path,
+                         const DocumentConfiguration &document_config,
+                         const DocumentTemplate &document_template) {
+    const auto [slotted_result, error] =
+        render_page(in_path, document_config, document_template);
+    if (error != Error::OK) {
+        return error;
+    }
+
+    std::ofstream out_file(out_path);
+    if (!out_file.is_open()) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    out_file << slotted_result;
+
+    return Error::OK;
+}
+} // namespace neng
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "document_template.hpp"
+#include "parallel.hpp"
+
+#include <functional>
+
+namespace neng {
+struct Page {
+    std::filesystem::path input;
+    // The path of the output relative to the output directory.
+    std::string output;
+    const DocumentTemplate *document_template;
+};
+
+struct PipelineOptions {
+    size_t read_workers{2};
+    size_t parse_workers{worker_count()};
+    size_t render_workers{worker_count()};
+    size_t write_workers{2};
+
+    // The cores that parsing and rendering are spread over. Each parse or
+    // render worker takes one for the page it is on, and pages too big for a
+    // single chunk are split across the ones that are left idle.
+    size_t cores{worker_count()};
+
+    // The most bytes that pages may hold between being read and being written
+    // out. Reading stops while the budget is used up. Zero means no limit.
+    size_t max_memory{0};
+
+    // Hands the pages to a single writer, in the order they are listed.
+    bool ordered_output{false};
+};
+
+// What run_render_pipeline measured while it ran.
+struct PipelineStats {
+    // The CPU time each page took to parse and render, by index. Pages big
+    // enough to be split between threads only count the calling thread's
+    // share.
+    std::vector<uint64_t> page_nanoseconds;
+    // The most threads each page was parsed or rendered on, by index.
+    std::vector<size_t> page_threads;
+    // The time on the clock from the first page starting to be parsed to the
+    // last one done rendering, which is what the page costs add up to once
+    // spread over the threads. Reading and writing are left out of both.
+    uint64_t render_span_nanoseconds{0};
+};
+
+// Called by the write stage with a fully rendered page.
+using PageWriter =
+    std::function<Error(const Page &page, std::string_view html)>;
+
+// Renders the pages through four stages, read -> parse -> render -> write,
+// each with its own threads and connected by bounded lock-free queues. Pages
+// are read in the order they are listed, and every stage takes whatever is
+// next in its queue, so a thread that finishes early simply picks up more of
+// the remaining pages. Pages that fail to render are reported and skipped.
+// Returns the first error from `write_page`, if any.
+Error run_render_pipeline(const std::vector<Page> &pages,
+                          const DocumentConfiguration &document_config,
+                          const PipelineOptions &options,
+                          const PageWriter &write_page,
+                          PipelineStats *stats = nullptr);
+
+// Renders a single page from start to finish on the calling thread.
+std::tuple<std::string, Error>
+render_page(const std::filesystem::path &in_path,
+            const DocumentConfiguration &document_config,
+            const DocumentTemplate &document_template);
+
+// Renders a single page and writes it to `out_path`.
+Error render_single_file(const std::filesystem::path &in_path,
+                         const std::filesystem::path &out_path,
+                         const DocumentConfiguration &document_config,
+                         const DocumentTemplate &document_template);
+
+// Parses sizes like "512", "64K", "300M" or "2G" into bytes.
+std::tuple<size_t, Error> parse_byte_size(std::string_view string);
+} // namespace neng
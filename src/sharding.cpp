@@ -0,0 +1,192 @@
+#include "sharding.hpp"
+#include "directory_walker.hpp"
+#include "hash.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace neng {
+std::tuple<ShardSpec, Error> parse_shard_spec(std::string_view string) {
+    const auto separator = string.find('/');
+    if (separator == std::string_view::npos) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+
+    const auto parse = [](std::string_view part, size_t &value) {
+        const auto [end, error_code] =
+            std::from_chars(part.data(), part.data() + part.size(), value);
+        return error_code == std::errc{} && end == part.data() + part.size();
+    };
+
+    size_t index = 0;
+    size_t count = 0;
+    if (!parse(string.substr(0, separator), index) ||
+        !parse(string.substr(separator + 1), count) || index == 0 ||
+        index > count) {
+        return {{}, Error::INVALID_SYNTAX};
+    }
+
+    return {ShardSpec{.index = index - 1, .count = count}, Error::OK};
+}
+
+std::vector<size_t> assign_shards(const std::vector<std::string> &pages,
+                                  size_t shard_count,
+                                  const BuildManifest *previous) {
+    std::unordered_map<std::string_view, size_t> balanced;
+
+    if (previous) {
+        std::vector<const ManifestPage *> by_size;
+        for (const auto &page : previous->pages) {
+            by_size.push_back(&page);
+        }
+
+        // Ties are broken by path, so that the order is the same everywhere.
+        std::sort(by_size.begin(), by_size.end(),
+                  [](const auto *a, const auto *b) {
+                      return a->size != b->size ? a->size > b->size
+                                                : a->input < b->input;
+                  });
+
+        std::vector<size_t> loads(shard_count, 0);
+        for (const auto *page : by_size) {
+            const auto lightest =
+                std::min_element(loads.begin(), loads.end()) - loads.begin();
+            loads[lightest] += page->size;
+            balanced.emplace(page->input, lightest);
+        }
+    }
+
+    std::vector<size_t> shards;
+    shards.reserve(pages.size());
+    for (const auto &page : pages) {
+        const auto found = balanced.find(page);
+        shards.push_back(found != balanced.end()
+                             ? found->second
+                             : fnv1a_hash(page) % shard_count);
+    }
+
+    return shards;
+}
+
+Error merge_shards(const std::vector<fs::path> &shard_paths,
+                   const fs::path &out_path, const fs::path &manifest_path,
+                   AssetCopyMode mode) {
+    BuildManifest merged;
+    std::vector<bool> seen_shards;
+
+    struct MergedFile {
+        fs::path input;
+        std::string output;
+    };
+    std::vector<MergedFile> files;
+    std::unordered_set<std::string> outputs;
+
+    // Only the pages listed in each shard's manifest are taken from it, so
+    // that files left in a shard's directory by an earlier build do not get
+    // mixed in.
+    const fs::path *first_shard_path = nullptr;
+    for (const auto &shard_path : shard_paths) {
+        const auto [manifest, error] =
+            BuildManifest::from_file(shard_path / SHARD_MANIFEST_NAME);
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: " << shard_path
+                      << " is not the output of a sharded build.\n";
+            return error;
+        }
+
+        if (seen_shards.empty()) {
+            seen_shards.resize(manifest.shard_count, false);
+        }
+
+        if (manifest.shard_count != seen_shards.size() ||
+            seen_shards[manifest.shard_index]) {
+            std::cerr << "[ERROR]: " << shard_path
+                      << " does not belong with the other shards.\n";
+            return Error::INVALID_SYNTAX;
+        }
+        seen_shards[manifest.shard_index] = true;
+        if (manifest.shard_index == 0) {
+            first_shard_path = &shard_path;
+        }
+
+        for (const auto &page : manifest.pages) {
+            if (!outputs.insert(page.output).second) {
+                std::cerr << "[ERROR]: " << page.output
+                          << " was written by more than one shard.\n";
+                return Error::INVALID_SYNTAX;
+            }
+
+            // A page that failed to render has no output, same as in a build
+            // that is not sharded.
+            if (fs::exists(shard_path / page.output)) {
+                files.push_back(
+                    {.input = shard_path / page.output, .output = page.output});
+            }
+        }
+
+        merged.pages.insert(merged.pages.end(), manifest.pages.begin(),
+                            manifest.pages.end());
+    }
+
+    if (seen_shards.empty()) {
+        std::cerr << "[ERROR]: There are no shards to merge.\n";
+        return Error::FILE_DOES_NOT_EXIST;
+    }
+
+    for (size_t i = 0; i < seen_shards.size(); i++) {
+        if (!seen_shards[i]) {
+            std::cerr << "[ERROR]: Shard " << i + 1 << '/'
+                      << seen_shards.size() << " is missing.\n";
+            return Error::FILE_DOES_NOT_EXIST;
+        }
+    }
+
+    // The assets only come out of the first shard. Anything in there that is
+    // the output of a page belongs to whichever shard rendered the page.
+    const auto [first_shard_files, walk_error] = walk_directory(
+        *first_shard_path, [](std::string_view file_name) {
+            return file_name != SHARD_MANIFEST_NAME;
+        });
+    if (walk_error != Error::OK) {
+        return walk_error;
+    }
+
+    for (const auto &file : first_shard_files) {
+        if (outputs.insert(file).second) {
+            files.push_back({.input = *first_shard_path / file, .output = file});
+        }
+    }
+
+    std::unordered_set<std::string_view> created_directories;
+    for (const auto &file : files) {
+        const auto separator = file.output.find_last_of('/');
+        const auto directory = std::string_view{file.output}.substr(
+            0, separator == std::string::npos ? 0 : separator);
+        if (created_directories.insert(directory).second) {
+            fs::create_directories(out_path / directory);
+        }
+    }
+
+    std::atomic<Error> copy_error{Error::OK};
+    parallel_for(files.size(), [&](size_t i) {
+        const auto error =
+            copy_asset(files[i].input, out_path / files[i].output, mode);
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to copy " << files[i].input << ": "
+                      << error << '\n';
+            auto expected = Error::OK;
+            copy_error.compare_exchange_strong(expected, error);
+        }
+    });
+
+    if (copy_error.load() != Error::OK) {
+        return copy_error.load();
+    }
+
+    return merged.write_to_file(manifest_path);
+}
+} // namespace neng
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "asset_copier.hpp"
+#include "build_manifest.hpp"
+
+namespace neng {
+struct ShardSpec {
+    // Counts from 0, even though --shard counts from 1.
+    size_t index;
+    size_t count;
+};
+
+// Parses "i/N" as given to --shard, with 1 <= i <= N.
+std::tuple<ShardSpec, Error> parse_shard_spec(std::string_view string);
+
+// Picks a shard for every page, given as paths relative to the pages
+// directory. Pages from `previous` (the last full build's manifest) are
+// spread by size, biggest first, each onto whichever shard has the least so
+// far. Anything else goes by a hash of its path. Either way the shard of a
+// page only depends on its path, the shard count and `previous`, so every
+// machine that has the same manifest agrees on it.
+std::vector<size_t> assign_shards(const std::vector<std::string> &pages,
+                                  size_t shard_count,
+                                  const BuildManifest *previous);
+
+// Where a sharded build leaves its manifest, inside of its output directory.
+constexpr std::string_view SHARD_MANIFEST_NAME = ".neng-manifest";
+
+// Puts the output directories of every shard of a build together into
+// `out_path`, and writes their combined manifest to `manifest_path`. Each
+// shard only contributes the pages in its manifest, and the first shard the
+// assets too, so that leftovers from earlier builds are never merged. Fails if
+// a shard is missing or repeated, or if two shards list the same page.
+Error merge_shards(const std::vector<std::filesystem::path> &shard_paths,
+                   const std::filesystem::path &out_path,
+                   const std::filesystem::path &manifest_path,
+                   AssetCopyMode mode);
+} // namespace neng
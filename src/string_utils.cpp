@@ -1,6 +1,7 @@
 #include <cstring>
 
 #include "string_utils.hpp"
+#include "lexer.hpp"
 
 namespace neng {
 std::vector<std::string> split_string(std::string_view string,
@@ -8,10 +9,10 @@ std::vector<std::string> split_string(std::string_view string,
     std::string current_segment;
     std::vector<std::string> segments;
 
-    for (int i = 0; i < string.size(); i++) {
+    for (size_t i = 0; i < string.size(); i++) {
         if (i + delimiter.size() - 1 < string.size()) {
             bool hit_delimiter = true;
-            for (int j = 0; j < delimiter.size(); j++) {
+            for (size_t j = 0; j < delimiter.size(); j++) {
                 if (string[i + j] != delimiter[j]) {
                     hit_delimiter = false;
                 }
@@ -34,39 +35,33 @@ std::vector<std::string> split_string(std::string_view string,
 }
 
 std::string trim_string_start(std::string_view string) {
-    std::string result;
-
-    bool trimming = true;
-    for (auto character : string) {
-        if (!std::isspace(character)) {
-            trimming = false;
-        }
-
-        if (!trimming) {
-            result.push_back(character);
-        }
+    size_t begin = 0;
+    while (begin < string.size() && is_space(string[begin])) {
+        begin++;
     }
 
-    return result;
+    return std::string(string.substr(begin));
 }
 
 std::string trim_string_end(std::string_view string) {
-    std::string result;
-
-    size_t trim_location = 0;
-    for (int32_t i = string.size() - 1; i >= 0; i--) {
-        if (!std::isspace(string[i])) {
-            trim_location = i;
-            break;
-        }
+    size_t end = string.size();
+    while (end > 0 && is_space(string[end - 1])) {
+        end--;
     }
 
-    result = string.substr(0, trim_location+1);
-
-    return result;
+    return std::string(string.substr(0, end));
 }
 
 std::string trim_string(std::string_view string) {
-    return trim_string_end(trim_string_start(string));
+    size_t begin = 0;
+    size_t end = string.size();
+    while (begin < end && is_space(string[begin])) {
+        begin++;
+    }
+    while (end > begin && is_space(string[end - 1])) {
+        end--;
+    }
+
+    return std::string(string.substr(begin, end - begin));
 }
 } // namespace neng
@@ -0,0 +1,318 @@
+#include "tar_writer.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std::literals::string_literals;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr size_t BLOCK_SIZE = 512;
+
+struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char link_name[100];
+    char magic[6];
+    char version[2];
+    char user_name[32];
+    char group_name[32];
+    char device_major[8];
+    char device_minor[8];
+    char prefix[155];
+    char padding[12];
+};
+
+static_assert(sizeof(TarHeader) == BLOCK_SIZE);
+
+// The most that the 11 octal digits of a ustar size field can hold, just
+// under 8 GiB.
+constexpr uint64_t MAX_USTAR_SIZE = (uint64_t{1} << 33) - 1;
+
+void write_octal(char *field, size_t field_size, uint64_t value) {
+    // The field is zero padded and ends with a NUL.
+    for (size_t i = field_size - 1; i > 0; i--) {
+        field[i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    field[field_size - 1] = '\0';
+}
+
+// Splits `name` into the prefix and name fields of a ustar header. Returns
+// false if it cannot be represented that way.
+bool split_name(std::string_view name, TarHeader &header) {
+    if (name.size() <= sizeof(header.name)) {
+        std::memcpy(header.name, name.data(), name.size());
+        return true;
+    }
+
+    // The split has to happen on a '/', which is then left out.
+    for (auto separator = name.find('/'); separator != std::string_view::npos;
+         separator = name.find('/', separator + 1)) {
+        const auto prefix = name.substr(0, separator);
+        const auto rest = name.substr(separator + 1);
+        if (prefix.size() <= sizeof(header.prefix) &&
+            rest.size() <= sizeof(header.name)) {
+            std::memcpy(header.prefix, prefix.data(), prefix.size());
+            std::memcpy(header.name, rest.data(), rest.size());
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TarHeader make_header(std::string_view name, uint64_t size, char type) {
+    TarHeader header;
+    std::memset(&header, 0, sizeof(header));
+
+    if (!split_name(name, header)) {
+        // The real name goes into a pax header in front of this one, so a
+        // truncated name is good enough here.
+        const auto truncated = name.substr(0, sizeof(header.name));
+        std::memcpy(header.name, truncated.data(), truncated.size());
+    }
+
+    // Everything besides the name and size is fixed so that building the same
+    // site twice produces the same archive.
+    write_octal(header.mode, sizeof(header.mode), 0644);
+    write_octal(header.uid, sizeof(header.uid), 0);
+    write_octal(header.gid, sizeof(header.gid), 0);
+    // A bigger size goes into a pax header in front of this one, which takes
+    // precedence over this field.
+    write_octal(header.size, sizeof(header.size),
+                size <= MAX_USTAR_SIZE ? size : 0);
+    write_octal(header.mtime, sizeof(header.mtime), 0);
+    header.type = type;
+    std::memcpy(header.magic, "ustar", 6);
+    std::memcpy(header.version, "00", 2);
+
+    std::memset(header.checksum, ' ', sizeof(header.checksum));
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        checksum += reinterpret_cast<const unsigned char *>(&header)[i];
+    }
+    write_octal(header.checksum, 7, checksum);
+    header.checksum[7] = ' ';
+
+    return header;
+}
+
+// A pax extended header record, which looks like "<length> <key>=<value>\n"
+// with the length counting itself.
+std::string make_pax_record(std::string_view key, std::string_view value) {
+    const auto body = " "s + std::string(key) + '=' + std::string(value) + '\n';
+    auto length = body.size() + 1;
+    while (std::to_string(length).size() + body.size() != length) {
+        length++;
+    }
+
+    return std::to_string(length) + body;
+}
+
+const char *compressor_for(const fs::path &path) {
+    const auto extension = path.extension();
+    if (extension == ".gz" || extension == ".tgz") {
+        return "gzip";
+    }
+    if (extension == ".zst") {
+        return "zstd";
+    }
+
+    return nullptr;
+}
+} // namespace
+
+namespace neng {
+TarWriter::TarWriter(TarWriter &&other) noexcept
+    : file(std::move(other.file)),
+      compressor_pid(std::exchange(other.compressor_pid, -1)) {}
+
+TarWriter &TarWriter::operator=(TarWriter &&other) noexcept {
+    if (this != &other) {
+        close_compressor();
+        file = std::move(other.file);
+        compressor_pid = std::exchange(other.compressor_pid, -1);
+    }
+
+    return *this;
+}
+
+TarWriter::~TarWriter() { close_compressor(); }
+
+std::tuple<TarWriter, Error> TarWriter::open(const fs::path &path) {
+    TarWriter writer;
+
+    const auto compressor = compressor_for(path);
+    if (compressor == nullptr) {
+        writer.file.reset(fopen(path.c_str(), "wb"));
+        if (!writer.file) {
+            return {TarWriter{}, Error::FILE_OPEN_ERROR};
+        }
+
+        return {std::move(writer), Error::OK};
+    }
+
+    const int out_fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0) {
+        return {TarWriter{}, Error::FILE_OPEN_ERROR};
+    }
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        close(out_fd);
+        return {TarWriter{}, Error::FILE_OPEN_ERROR};
+    }
+
+    const auto pid = fork();
+    if (pid == 0) {
+        dup2(pipe_fds[0], STDIN_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        execlp(compressor, compressor, "-c", "-q", nullptr);
+        _exit(127);
+    }
+
+    close(pipe_fds[0]);
+    close(out_fd);
+
+    if (pid < 0) {
+        close(pipe_fds[1]);
+        return {TarWriter{}, Error::FILE_OPEN_ERROR};
+    }
+
+    writer.file.reset(fdopen(pipe_fds[1], "wb"));
+    writer.compressor_pid = pid;
+
+    return {std::move(writer), Error::OK};
+}
+
+Error TarWriter::add_file(std::string_view name, std::string_view contents) {
+    if (write_header(name, contents.size()) != Error::OK ||
+        fwrite(contents.data(), 1, contents.size(), file.get()) !=
+            contents.size()) {
+        return Error::FILE_WRITE_ERROR;
+    }
+
+    return write_padding(contents.size());
+}
+
+Error TarWriter::add_file_from_disk(std::string_view name,
+                                    const fs::path &source) {
+    const int source_fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0) {
+        return Error::FILE_OPEN_ERROR;
+    }
+
+    struct stat source_stat;
+    if (fstat(source_fd, &source_stat) != 0) {
+        close(source_fd);
+        return Error::FILE_READ_ERROR;
+    }
+
+    const auto size = static_cast<size_t>(source_stat.st_size);
+    if (write_header(name, size) != Error::OK || fflush(file.get()) != 0) {
+        close(source_fd);
+        return Error::FILE_WRITE_ERROR;
+    }
+
+    size_t sent = 0;
+    while (sent < size) {
+        const auto result =
+            sendfile(fileno(file.get()), source_fd, nullptr, size - sent);
+        if (result <= 0) {
+            close(source_fd);
+            return Error::FILE_WRITE_ERROR;
+        }
+        sent += result;
+    }
+
+    close(source_fd);
+    return write_padding(size);
+}
+
+Error TarWriter::write_header(std::string_view name, size_t size) {
+    std::string records;
+
+    TarHeader probe;
+    std::memset(&probe, 0, sizeof(probe));
+    if (!split_name(name, probe)) {
+        records += make_pax_record("path", name);
+    }
+    if (size > MAX_USTAR_SIZE) {
+        records += make_pax_record("size", std::to_string(size));
+    }
+
+    if (!records.empty()) {
+        const auto header = make_header("PaxHeader", records.size(), 'x');
+        if (fwrite(&header, sizeof(header), 1, file.get()) != 1 ||
+            fwrite(records.data(), 1, records.size(), file.get()) !=
+                records.size() ||
+            write_padding(records.size()) != Error::OK) {
+            return Error::FILE_WRITE_ERROR;
+        }
+    }
+
+    const auto header = make_header(name, size, '0');
+    if (fwrite(&header, sizeof(header), 1, file.get()) != 1) {
+        return Error::FILE_WRITE_ERROR;
+    }
+
+    return Error::OK;
+}
+
+Error TarWriter::write_padding(size_t size) {
+    static const char zeros[BLOCK_SIZE] = {};
+
+    const auto padding = (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+    if (fwrite(zeros, 1, padding, file.get()) != padding) {
+        return Error::FILE_WRITE_ERROR;
+    }
+
+    return Error::OK;
+}
+
+Error TarWriter::finish() {
+    static const char zeros[BLOCK_SIZE * 2] = {};
+
+    auto error = Error::OK;
+    if (fwrite(zeros, 1, sizeof(zeros), file.get()) != sizeof(zeros) ||
+        fflush(file.get()) != 0) {
+        error = Error::FILE_WRITE_ERROR;
+    }
+
+    if (!close_compressor()) {
+        std::cerr << "[ERROR]: The archive compressor exited with an error.\n";
+        error = Error::FILE_WRITE_ERROR;
+    }
+
+    return error;
+}
+
+bool TarWriter::close_compressor() {
+    // The compressor only exits once its end of the pipe is closed.
+    file.reset();
+
+    if (compressor_pid <= 0) {
+        return true;
+    }
+
+    int status = 0;
+    const bool succeeded = waitpid(compressor_pid, &status, 0) >= 0 &&
+                           WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    compressor_pid = -1;
+
+    return succeeded;
+}
+} // namespace neng
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "document.hpp"
+
+namespace neng {
+// Streams a ustar archive to disk, one entry after another. An archive path
+// ending with .gz/.tgz or .zst is piped through gzip or zstd on the way out,
+// so the uncompressed archive never touches the disk either.
+//
+// There is exactly one writer per archive; callers that produce entries on
+// several threads have to funnel them through a single thread.
+//
+// SIGPIPE has to be ignored for a compressor that exits early to come back as
+// Error::FILE_WRITE_ERROR, which main takes care of.
+//
+// A writer that goes away without finish() still closes the archive and
+// waits for its compressor, but the archive is left without its end marker.
+struct TarWriter {
+    std::unique_ptr<FILE, int (*)(FILE *)> file{nullptr, fclose};
+    // The compressor process, if there is one.
+    int compressor_pid{-1};
+
+    TarWriter() = default;
+    TarWriter(TarWriter &&other) noexcept;
+    TarWriter &operator=(TarWriter &&other) noexcept;
+    ~TarWriter();
+
+    static std::tuple<TarWriter, Error>
+    open(const std::filesystem::path &path);
+
+    // `name` is the path of the entry inside of the archive.
+    Error add_file(std::string_view name, std::string_view contents);
+
+    // Same as add_file, except that the contents are sent straight from
+    // `source` to the archive by the kernel.
+    Error add_file_from_disk(std::string_view name,
+                             const std::filesystem::path &source);
+
+    // Writes the end-of-archive marker and waits for the compressor.
+    Error finish();
+
+    // Writes the header of a regular file, preceded by a pax header if the
+    // name is too long for ustar or the file is too big for it, at 8 GiB.
+    Error write_header(std::string_view name, size_t size);
+
+    // Pads the data of an entry out to a whole block.
+    Error write_padding(size_t size);
+
+    // Closes the archive and waits for the compressor, if there is one.
+    // Returns whether the compressor succeeded.
+    bool close_compressor();
+};
+} // namespace neng
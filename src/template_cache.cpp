@@ -0,0 +1,93 @@
+#include "template_cache.hpp"
+#include "asset_fingerprints.hpp"
+#include "directory_walker.hpp"
+
+namespace fs = std::filesystem;
+
+namespace neng {
+std::tuple<TemplateCache, Error>
+TemplateCache::from_directory(const fs::path &pages_path,
+                              DocumentTemplate root_template) {
+    const auto [template_paths, error] = walk_directory(
+        pages_path,
+        [](std::string_view file_name) { return file_name == "template.html"; });
+    if (error != Error::OK) {
+        return {{}, error};
+    }
+
+    return from_files(pages_path, std::move(root_template), template_paths);
+}
+
+std::tuple<TemplateCache, Error>
+TemplateCache::from_files(const fs::path &pages_path,
+                          DocumentTemplate root_template,
+                          const std::vector<std::string> &template_paths) {
+    TemplateCache cache;
+    cache.templates.emplace("", std::move(root_template));
+
+    for (const auto &template_path : template_paths) {
+        const auto file_path = pages_path / template_path;
+
+        auto [document_template, error] = DocumentTemplate::from_file(file_path);
+        if (error != Error::OK) {
+            std::cerr << "[ERROR]: Failed to parse the template " << file_path
+                      << ": " << error << '\n';
+            return {{}, error};
+        }
+
+        const auto separator = template_path.find_last_of('/');
+        cache.templates.insert_or_assign(
+            separator == std::string::npos ? ""
+                                           : template_path.substr(0, separator),
+            std::move(document_template));
+    }
+
+    return {std::move(cache), Error::OK};
+}
+
+void TemplateCache::minify() {
+    for (auto &[directory, document_template] : templates) {
+        document_template.minify();
+    }
+}
+
+Error TemplateCache::resolve_assets(AssetFingerprints &fingerprints) {
+    std::vector<DocumentTemplate *> document_templates;
+    for (auto &[directory, document_template] : templates) {
+        document_templates.push_back(&document_template);
+    }
+
+    std::vector<Error> errors(document_templates.size(), Error::OK);
+    parallel_for(document_templates.size(), [&](size_t i) {
+        errors[i] = document_templates[i]->resolve_assets(fingerprints);
+    });
+
+    for (const auto error : errors) {
+        if (error != Error::OK) {
+            return error;
+        }
+    }
+
+    return Error::OK;
+}
+
+const DocumentTemplate &
+TemplateCache::find(std::string_view relative_directory) const {
+    std::string key{relative_directory};
+    if (key == ".") {
+        key.clear();
+    }
+
+    while (!key.empty()) {
+        const auto found = templates.find(key);
+        if (found != templates.end()) {
+            return found->second;
+        }
+
+        const auto separator = key.find_last_of('/');
+        key.resize(separator == std::string::npos ? 0 : separator);
+    }
+
+    return templates.at("");
+}
+} // namespace neng
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "document_template.hpp"
+
+namespace neng {
+// All of the templates used by a site, compiled once up front and keyed by the
+// directory (relative to the pages directory) that they apply to. The root
+// template lives under the empty key. Nothing is mutated after the cache is
+// built, so the render workers can share it without any locking.
+struct TemplateCache {
+    std::unordered_map<std::string, DocumentTemplate> templates;
+
+    static std::tuple<TemplateCache, Error>
+    from_directory(const std::filesystem::path &pages_path,
+                   DocumentTemplate root_template);
+
+    // Same as from_directory, for when the template.html files have already
+    // been found. The paths are relative to `pages_path`.
+    static std::tuple<TemplateCache, Error>
+    from_files(const std::filesystem::path &pages_path,
+               DocumentTemplate root_template,
+               const std::vector<std::string> &template_paths);
+
+    // Minifies every template in the cache. See DocumentTemplate::minify.
+    void minify();
+
+    // Resolves the assets of every template in the cache, sharing the hashes
+    // between them. See DocumentTemplate::resolve_assets.
+    Error resolve_assets(AssetFingerprints &fingerprints);
+
+    // Finds the template of the nearest directory at or above
+    // `relative_directory`, falling back to the root template.
+    const DocumentTemplate &find(std::string_view relative_directory) const;
+};
+} // namespace neng
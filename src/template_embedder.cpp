@@ -0,0 +1,119 @@
+// Turns a template into a C++ source file that holds its segments in a
+// constexpr table, so that it can be compiled into the processor. Run by the
+// build when PROCESSOR_EMBED_TEMPLATE is set; see embedded_template.hpp.
+//
+//     template_embedder <template> <output source> <variable name>
+
+#include "document_template.hpp"
+
+#include <cstdio>
+
+namespace {
+using neng::DocumentTemplate;
+using neng::Error;
+using neng::TemplateSegment;
+
+std::string_view type_name(TemplateSegment::Type type) {
+    switch (type) {
+        case TemplateSegment::Type::VARIABLE:
+            return "VARIABLE";
+        case TemplateSegment::Type::TEXT:
+            return "TEXT";
+        case TemplateSegment::Type::ASSET:
+            return "ASSET";
+    }
+
+    return "TEXT";
+}
+
+// A string literal with the same bytes as `string`. Everything that is not
+// printable ASCII is written as a three digit octal escape, which, unlike a
+// hex escape, cannot run into the character after it.
+std::string string_literal(std::string_view string) {
+    std::string literal = "\"";
+
+    for (const auto character : string) {
+        const auto byte = static_cast<unsigned char>(character);
+        // A ? is escaped too, so that no ?? in the template is ever read as
+        // the start of a trigraph.
+        if (character == '"' || character == '\\' || character == '?') {
+            literal += '\\';
+            literal += character;
+        } else if (character == '\n') {
+            // Keeps the generated file readable for templates with many lines.
+            literal += "\\n\"\n        \"";
+        } else if (byte < 0x20 || byte >= 0x7F) {
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", byte);
+            literal += escape;
+        } else {
+            literal += character;
+        }
+    }
+
+    literal += '"';
+    return literal;
+}
+
+std::string embed_template(const DocumentTemplate &document_template,
+                           std::string_view name,
+                           const std::filesystem::path &template_path) {
+    std::string source;
+    source += "// Generated by template_embedder from ";
+    source += template_path.filename().string();
+    source += ". Do not edit.\n\n";
+    source += "#include \"embedded_template.hpp\"\n\n";
+    source += "namespace {\n";
+    source += "constexpr neng::EmbeddedSegment SEGMENTS[] = {\n";
+
+    for (const auto &segment : document_template.segments) {
+        source += "    {\n";
+        source += "        neng::TemplateSegment::Type::";
+        source += type_name(segment.type);
+        source += ",\n        std::string_view{";
+        source += string_literal(segment.a);
+        source += ",\n                         ";
+        source += std::to_string(segment.a.size());
+        source += "},\n    },\n";
+    }
+
+    source += "};\n";
+    source += "} // namespace\n\n";
+    source += "namespace neng {\n";
+    source += "const std::span<const EmbeddedSegment> ";
+    source += name;
+    source += "{SEGMENTS};\n";
+    source += "} // namespace neng\n";
+
+    return source;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        std::cerr << "[ERROR]: Usage: template_embedder <template> <output "
+                     "source> <variable name>\n";
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path template_path{argv[1]};
+    const std::filesystem::path output_path{argv[2]};
+
+    const auto [document_template, error] =
+        DocumentTemplate::from_file(template_path);
+    if (error != Error::OK) {
+        std::cerr << "[ERROR]: Failed to parse the template " << template_path
+                  << ": " << error << '\n';
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream output{output_path, std::ios::binary};
+    output << embed_template(document_template, argv[3], template_path);
+    output.close();
+    if (!output) {
+        std::cerr << "[ERROR]: Failed to write " << output_path << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
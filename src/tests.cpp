@@ -1,9 +1,34 @@
+#include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "asset_copier.hpp"
+#include "asset_fingerprints.hpp"
+#include "batch.hpp"
+#include "directory_walker.hpp"
 #include "document.hpp"
 #include "document_template.hpp"
+#include "embedded_template.hpp"
+#include "flat_document.hpp"
+#include "fragment_cache.hpp"
+#include "html_minifier.hpp"
+#include "incremental_document.hpp"
+#include "input_normalizer.hpp"
+#include "lexer.hpp"
+#include "page_scheduler.hpp"
+#include "render_daemon.hpp"
+#include "render_pipeline.hpp"
+#include "sharding.hpp"
 #include "string_utils.hpp"
+#include "tar_writer.hpp"
+#include "template_cache.hpp"
 
 struct TestResult {
     bool passed;
@@ -56,6 +81,45 @@ inline void run_test(std::string_view name, F function) {
 
 #define TEST []() -> TestResult
 
+// A directory of its own under the system's temporary directory, removed
+// along with everything in it at the end of the test.
+struct TemporaryDirectory {
+    std::filesystem::path path;
+
+    TemporaryDirectory() {
+        auto pattern =
+            (std::filesystem::temp_directory_path() / "neng-test-XXXXXX")
+                .string();
+        if (mkdtemp(pattern.data()) == nullptr) {
+            throw std::runtime_error("Failed to create a temporary directory");
+        }
+        path = pattern;
+    }
+
+    TemporaryDirectory(const TemporaryDirectory &) = delete;
+    TemporaryDirectory &operator=(const TemporaryDirectory &) = delete;
+
+    ~TemporaryDirectory() {
+        std::error_code error;
+        std::filesystem::remove_all(path, error);
+    }
+};
+
+// Collects what is written to std::cerr for as long as it is around, so that
+// the errors a test expects stay out of the test output.
+struct CapturedErrors {
+    std::stringstream text;
+    std::streambuf *previous{std::cerr.rdbuf(text.rdbuf())};
+
+    CapturedErrors() = default;
+    CapturedErrors(const CapturedErrors &) = delete;
+    CapturedErrors &operator=(const CapturedErrors &) = delete;
+
+    ~CapturedErrors() { std::cerr.rdbuf(previous); }
+
+    std::string str() const { return text.str(); }
+};
+
 namespace neng {
 void run_tests() {
     std::cout << "[INFO]: Working directory at "
@@ -68,7 +132,7 @@ void run_tests() {
 
             const auto results = neng::split_string(hello, ",");
 
-            for (int i = 0; i < expected.size(); i++) {
+            for (size_t i = 0; i < expected.size(); i++) {
                 ASSERT_EQ(expected[i], results[i]);
             }
 
@@ -137,6 +201,9 @@ void run_tests() {
             ASSERT(neng::is_line_title("## Yes!"));
             ASSERT(!neng::is_line_title("Bozo!"));
             ASSERT(!neng::is_line_title("#Cringe"));
+            ASSERT(neng::is_line_title("# "));
+            ASSERT(!neng::is_line_title("  # Indented"));
+            ASSERT(!neng::is_line_title("#\tTab"));
 
             SUCCESS;
         });
@@ -204,5 +271,1107 @@ void run_tests() {
 
             SUCCESS;
         });
+
+    run_test(
+        "routing templates by directory", TEST {
+            using neng::DocumentTemplate;
+            using neng::TemplateCache;
+
+            const auto [root, error] =
+                DocumentTemplate::from_file("tests/site/template.html");
+            ASSERT_EQ(error, Error::OK);
+
+            const auto [cache, error2] =
+                TemplateCache::from_directory("tests/site/pages/", root);
+            ASSERT_EQ(error2, Error::OK);
+
+            ASSERT_EQ(cache.templates.size(), 2);
+            ASSERT_EQ(cache.find(".").render_to_string("A", "B"),
+                      "<title>A</title>B");
+            ASSERT_EQ(cache.find("docs/guide").render_to_string("A", "B"),
+                      "<title>A</title>B");
+            ASSERT_EQ(cache.find("blog").render_to_string("A", "B"),
+                      "<article>B</article>");
+            ASSERT_EQ(cache.find("blog/2024/05").render_to_string("A", "B"),
+                      "<article>B</article>");
+
+            SUCCESS;
+        });
+
+    run_test(
+        "walking directories", TEST {
+            const auto [files, error] = neng::walk_directory(
+                "tests/site/pages", neng::has_extension(".md"));
+            ASSERT_EQ(error, Error::OK);
+
+            const std::vector<std::string> expected{
+                "blog/first-post.md",
+                "docs/guide/intro.md",
+                "index.md",
+            };
+            ASSERT(files == expected);
+
+            const auto [none, error2] =
+                neng::walk_directory("tests/does-not-exist", [](auto) {
+                    return true;
+                });
+            ASSERT_EQ(error2, Error::FILE_OPEN_ERROR);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "writing tar archives", TEST {
+            const TemporaryDirectory directory;
+            const auto archive_path = directory.path / "site.tar";
+
+            auto [archive, error] = neng::TarWriter::open(archive_path);
+            ASSERT_EQ(error, Error::OK);
+
+            const auto long_name = "pages/" + std::string(200, 'a') + ".html";
+            ASSERT_EQ(archive.add_file("pages/index.html", "Hello!"),
+                      Error::OK);
+            ASSERT_EQ(archive.add_file(long_name, "Long!"), Error::OK);
+            ASSERT_EQ(archive.finish(), Error::OK);
+
+            std::ifstream file(archive_path, std::ios::binary);
+            const std::string bytes{std::istreambuf_iterator<char>(file), {}};
+
+            // Two blocks for the short entry, two for the pax header, two for
+            // the long entry and two for the end marker.
+            ASSERT_EQ(bytes.size(), 512 * 8);
+            ASSERT_EQ(bytes.substr(0, 16), "pages/index.html");
+            ASSERT_EQ(bytes.substr(257, 5), "ustar");
+            ASSERT_EQ(bytes.substr(512, 6), "Hello!");
+            ASSERT_EQ(bytes[1024 + 156], 'x');
+            ASSERT(bytes.find("path=" + long_name + "\n") != std::string::npos);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "writing tar entries of 8 GiB and more", TEST {
+            const TemporaryDirectory directory;
+            const auto archive_path = directory.path / "big.tar";
+
+            // Only the header is written; what matters is how it says the
+            // size.
+            const uint64_t size = (uint64_t{1} << 33) + 1;
+            {
+                auto [archive, error] = neng::TarWriter::open(archive_path);
+                ASSERT_EQ(error, Error::OK);
+                ASSERT_EQ(archive.write_header("big.bin", size), Error::OK);
+                ASSERT_EQ(archive.finish(), Error::OK);
+            }
+
+            std::ifstream file(archive_path, std::ios::binary);
+            const std::string bytes{std::istreambuf_iterator<char>(file), {}};
+
+            ASSERT_EQ(bytes[156], 'x');
+            ASSERT(bytes.find(" size=8589934593\n") != std::string::npos);
+            ASSERT_EQ(bytes.substr(1024, 7), "big.bin");
+            ASSERT_EQ(bytes.substr(1024 + 124, 11), "00000000000");
+
+            // A writer dropped without finish() still waits for its
+            // compressor, which has written out everything by then.
+            const auto compressed_path = directory.path / "site.tar.gz";
+            {
+                auto [archive, error] = neng::TarWriter::open(compressed_path);
+                ASSERT_EQ(error, Error::OK);
+                ASSERT(archive.compressor_pid > 0);
+                ASSERT_EQ(archive.add_file("index.html", "Hello!"), Error::OK);
+            }
+            ASSERT(std::filesystem::file_size(compressed_path) > 0);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "copying assets", TEST {
+            namespace fs = std::filesystem;
+            using neng::AssetCopyMode;
+
+            const TemporaryDirectory directory;
+            const auto copy_path = directory.path / "basic.md";
+            const auto original_size = fs::file_size("tests/basic.md");
+
+            ASSERT_EQ(neng::copy_asset("tests/basic.md", copy_path,
+                                       AssetCopyMode::COPY),
+                      Error::OK);
+            ASSERT_EQ(fs::file_size(copy_path), original_size);
+            ASSERT(fs::last_write_time(copy_path) ==
+                   fs::last_write_time("tests/basic.md"));
+            ASSERT(!fs::equivalent(copy_path, "tests/basic.md"));
+
+            // Up to date copies are left alone.
+            ASSERT_EQ(neng::copy_asset("tests/basic.md", copy_path,
+                                       AssetCopyMode::COPY),
+                      Error::OK);
+
+            ASSERT_EQ(neng::copy_asset("tests/basic.md", copy_path,
+                                       AssetCopyMode::HARDLINK),
+                      Error::OK);
+            ASSERT(fs::equivalent(copy_path, "tests/basic.md"));
+
+            // A hardlink does not pass for an up to date copy.
+            ASSERT_EQ(neng::copy_asset("tests/basic.md", copy_path,
+                                       AssetCopyMode::COPY),
+                      Error::OK);
+            ASSERT(!fs::equivalent(copy_path, "tests/basic.md"));
+            ASSERT_EQ(fs::file_size(copy_path), original_size);
+
+            ASSERT_EQ(neng::copy_asset("tests/basic.md", copy_path,
+                                       AssetCopyMode::HARDLINK),
+                      Error::OK);
+
+            // Going back to copies must not write through the hardlink.
+            ASSERT_EQ(neng::copy_asset("tests/basic.html", copy_path,
+                                       AssetCopyMode::COPY),
+                      Error::OK);
+            ASSERT(!fs::equivalent(copy_path, "tests/basic.md"));
+            ASSERT_EQ(fs::file_size("tests/basic.md"), original_size);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "rendering pages through the pipeline", TEST {
+            using neng::DocumentTemplate;
+
+            const auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+
+            const auto [templ, error2] =
+                DocumentTemplate::from_string("${{title}}|${{body}}");
+            ASSERT_EQ(error2, Error::OK);
+
+            std::vector<neng::Page> pages;
+            for (int i = 0; i < 40; i++) {
+                pages.push_back({
+                    .input = i % 2 == 0 ? "tests/basic.md"
+                                        : "tests/site/pages/index.md",
+                    .output = std::to_string(i),
+                    .document_template = &templ,
+                });
+            }
+            pages.push_back({
+                .input = "tests/does-not-exist.md",
+                .output = "missing",
+                .document_template = &templ,
+            });
+
+            std::vector<std::string> written;
+            std::string first_html;
+            const CapturedErrors errors;
+            const auto write_error = neng::run_render_pipeline(
+                pages, config,
+                {
+                    .read_workers = 3,
+                    .parse_workers = 2,
+                    .render_workers = 2,
+                    .max_memory = 64,
+                    .ordered_output = true,
+                },
+                [&](const neng::Page &page, std::string_view html) {
+                    written.push_back(page.output);
+                    if (page.output == "0") {
+                        first_html = html;
+                    }
+                    return Error::OK;
+                });
+            ASSERT_EQ(write_error, Error::OK);
+            ASSERT(errors.str().find("does-not-exist.md") != std::string::npos);
+
+            ASSERT_EQ(first_html.substr(0, 6), "Hello|");
+            ASSERT_EQ(written.size(), 40);
+            for (int i = 0; i < 40; i++) {
+                ASSERT_EQ(written[i], std::to_string(i));
+            }
+
+            SUCCESS;
+        });
+
+    run_test(
+        "splitting big pages in the pipeline", TEST {
+            using neng::DocumentTemplate;
+
+            const auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+
+            const auto [templ, error2] =
+                DocumentTemplate::from_string("${{body}}");
+            ASSERT_EQ(error2, Error::OK);
+
+            const TemporaryDirectory directory;
+            const auto big_path = directory.path / "big.md";
+            std::string source;
+            while (source.size() < neng::PARALLEL_CHUNK_SIZE * 3) {
+                source += "# A heading\n\nSome text that goes on\nfor a "
+                          "while.\n\n";
+            }
+            std::ofstream{big_path} << source;
+
+            const std::vector<neng::Page> pages{
+                {
+                    .input = "tests/basic.md",
+                    .output = "small",
+                    .document_template = &templ,
+                },
+                {
+                    .input = big_path,
+                    .output = "big",
+                    .document_template = &templ,
+                },
+            };
+
+            // Once the small page is done, the big one has the idle cores
+            // to itself, however many workers there are.
+            std::string big_html;
+            neng::PipelineStats stats;
+            const auto write_error = neng::run_render_pipeline(
+                pages, config,
+                {
+                    .parse_workers = 1,
+                    .render_workers = 1,
+                    .cores = 4,
+                },
+                [&](const neng::Page &page, std::string_view html) {
+                    if (page.output == "big") {
+                        big_html = html;
+                    }
+                    return Error::OK;
+                },
+                &stats);
+            ASSERT_EQ(write_error, Error::OK);
+
+            ASSERT_EQ(stats.page_threads.size(), 2);
+            ASSERT_EQ(stats.page_threads[0], 1);
+            ASSERT(stats.page_threads[1] > 1);
+            ASSERT(stats.page_threads[1] <= 4);
+            ASSERT(big_html == config.render_html_to_string(
+                                   neng::FlatDocument::parse(source)));
+
+            SUCCESS;
+        });
+
+    run_test(
+        "rendering through the daemon", TEST {
+            using neng::RenderRequestKind;
+
+            const TemporaryDirectory directory;
+            const auto socket_path = directory.path / "daemon.sock";
+
+            // Anything but a socket at the path is left alone.
+            std::ofstream{socket_path} << "Not a socket";
+            {
+                const CapturedErrors errors;
+                ASSERT_EQ(neng::run_daemon({
+                              .socket_path = socket_path,
+                              .config_path = "tests/basic.neng",
+                              .template_path = "tests/basic.html",
+                              .worker_count = 1,
+                          }),
+                          Error::FILE_OPEN_ERROR);
+                ASSERT(errors.str().find("is not a socket") !=
+                       std::string::npos);
+            }
+            ASSERT(std::filesystem::is_regular_file(socket_path));
+            std::filesystem::remove(socket_path);
+
+            std::atomic<bool> stop{false};
+            auto daemon_error = Error::OK;
+            std::thread daemon{[&]() {
+                daemon_error = neng::run_daemon(
+                    {
+                        .socket_path = socket_path,
+                        .config_path = "tests/basic.neng",
+                        .template_path = "tests/basic.html",
+                        .worker_count = 2,
+                    },
+                    stop);
+            }};
+
+            auto [html, error] =
+                neng::request_render(socket_path, RenderRequestKind::MARKDOWN,
+                                     "# Hi\n\nThere.");
+            for (int i = 0; i < 100 && error == Error::FILE_OPEN_ERROR; i++) {
+                // The daemon might not be listening yet.
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                std::tie(html, error) = neng::request_render(
+                    socket_path, RenderRequestKind::MARKDOWN,
+                    "# Hi\n\nThere.");
+            }
+
+            // Idle connections, more of them than there are workers, keep
+            // no one else waiting.
+            std::vector<int> idle_fds;
+            for (int i = 0; i < 3; i++) {
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+                std::strcpy(address.sun_path, socket_path.c_str());
+                idle_fds.push_back(socket(AF_UNIX, SOCK_STREAM, 0));
+                ASSERT_EQ(connect(idle_fds.back(),
+                                  reinterpret_cast<const sockaddr *>(&address),
+                                  sizeof(address)),
+                          0);
+            }
+
+            const auto [file_html, file_error] = neng::request_render(
+                socket_path, RenderRequestKind::FILE, "tests/basic.md");
+            const auto [missing_html, missing_error] = neng::request_render(
+                socket_path, RenderRequestKind::FILE, "tests/nope.md");
+
+            for (const auto fd : idle_fds) {
+                close(fd);
+            }
+
+            stop = true;
+            daemon.join();
+
+            ASSERT(!std::filesystem::exists(socket_path));
+
+            ASSERT_EQ(daemon_error, Error::OK);
+            ASSERT_EQ(error, Error::OK);
+            ASSERT_EQ(html.substr(0, 29), "Hello! Here is the title: Hi.");
+            ASSERT_EQ(file_error, Error::OK);
+            ASSERT(file_html.find("<h1 class=\"title\">Hello</h1>") !=
+                   std::string::npos);
+            ASSERT_EQ(missing_error, Error::FILE_OPEN_ERROR);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "rendering batches", TEST {
+            const TemporaryDirectory directory;
+            const auto output_path = directory.path / "batch.html";
+
+            const auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+
+            std::stringstream manifest;
+            manifest << "tests/basic.md\t" << output_path.string()
+                     << "\ttests/site/pages/blog/template.html\n"
+                     << "\n"
+                     << "no tabs here\n"
+                     << "tests/nope.md\t" << output_path.string() << '\n';
+
+            std::stringstream status;
+            const auto result =
+                neng::run_batch(manifest, config, "tests/basic.html", status);
+            ASSERT_EQ(result, Error::FILE_OPEN_ERROR);
+            ASSERT_EQ(status.str(), "1\tOK\ttests/basic.md\n"
+                                    "3\tINVALID_SYNTAX\t\n"
+                                    "4\tFILE_OPEN_ERROR\ttests/nope.md\n");
+
+            std::ifstream output(output_path);
+            std::string html;
+            std::getline(output, html);
+            ASSERT_EQ(html.substr(0, 9), "<article>");
+
+            SUCCESS;
+        });
+
+    run_test(
+        "lexing lines", TEST {
+            using neng::LineKind;
+
+            const auto content = [](std::string_view line) {
+                const auto token = neng::lex_line(line);
+                return line.substr(token.content_begin,
+                                   token.content_end - token.content_begin);
+            };
+
+            ASSERT(neng::lex_line("").kind == LineKind::BLANK);
+            ASSERT(neng::lex_line(" \t\r\v").kind == LineKind::BLANK);
+
+            const auto heading = neng::lex_line("  ### A title \r");
+            ASSERT(heading.kind == LineKind::HEADING);
+            ASSERT_EQ(heading.header_level, 3);
+            ASSERT_EQ(content("  ### A title \r"), "A title");
+
+            ASSERT(neng::lex_line("#NoSpace").kind == LineKind::TEXT);
+            ASSERT(neng::lex_line("# ").kind == LineKind::TEXT);
+            ASSERT(neng::lex_line("#\tTab").kind == LineKind::TEXT);
+            ASSERT_EQ(content("\t Some text\t "), "Some text");
+
+            // Bytes outside of ASCII are never whitespace.
+            ASSERT_EQ(content("\xa0" "caf\xc3\xa9\xa0"),
+                      "\xa0" "caf\xc3\xa9\xa0");
+
+            SUCCESS;
+        });
+
+    run_test(
+        "re-parsing edited documents incrementally", TEST {
+            using neng::IncrementalDocument;
+
+            const auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+
+            const std::array<std::string_view, 8> pieces{
+                "# Title\n", "Some text\n", "\n", "more text ",
+                "## Sub\n",  "   \n",       "x",   "\n\n",
+            };
+
+            // Edits the document at random and checks every step against a
+            // full parse.
+            uint32_t seed = 12345;
+            const auto next_random = [&](uint32_t bound) {
+                seed = seed * 1664525 + 1013904223;
+                return (seed >> 8) % bound;
+            };
+
+            std::string source = "# Hello\n\nA paragraph\nover lines.\n";
+            auto document = IncrementalDocument::parse(source, config);
+
+            for (int i = 0; i < 500; i++) {
+                const auto position = next_random(source.size() + 1);
+                if (next_random(3) == 0 && !source.empty()) {
+                    source.erase(position,
+                                 next_random(8) + 1);
+                } else {
+                    source.insert(position, pieces[next_random(8)]);
+                }
+
+                document.update(source, config);
+
+                const auto expected = Document::parse_document(source);
+                ASSERT_EQ(document.render_html(),
+                          config.render_html_to_string(expected));
+                ASSERT_EQ(document.get_title(), expected.get_title());
+                ASSERT_EQ(document.to_document().paragraphs.size(),
+                          expected.paragraphs.size());
+            }
+
+            SUCCESS;
+        });
+
+    run_test(
+        "laying documents out flat", TEST {
+            using neng::FlatDocument;
+
+            const auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+
+            for (const std::string_view source : {
+                     "",
+                     "# Title\n\nSome text\nover two lines.\n",
+                     "text right before\n## a heading\nand after",
+                     "   \n\t#not a heading\n###### \n### Deep  \n\n",
+                 }) {
+                const auto expected = Document::parse_document(source);
+                const auto flat = FlatDocument::parse(source);
+
+                ASSERT_EQ(flat.size(), expected.paragraphs.size());
+                ASSERT_EQ(config.render_html_to_string(flat),
+                          config.render_html_to_string(expected));
+                ASSERT_EQ(flat.get_title(), expected.get_title());
+                ASSERT_EQ(config.render_html_to_string(flat.to_document()),
+                          config.render_html_to_string(expected));
+
+                const auto [loaded, load_error] =
+                    FlatDocument::deserialize(flat.serialize());
+                ASSERT_EQ(load_error, Error::OK);
+                ASSERT_EQ(loaded.serialize(), flat.serialize());
+            }
+
+            const TemporaryDirectory directory;
+            const auto path = directory.path / "saved.flat";
+            const auto flat = FlatDocument::parse("# Saved\n\nbody");
+            ASSERT_EQ(flat.write_to_file(path), Error::OK);
+
+            const auto [mapped, map_error] = FlatDocument::from_file(path);
+            ASSERT_EQ(map_error, Error::OK);
+            ASSERT_EQ(config.render_html_to_string(mapped),
+                      config.render_html_to_string(flat));
+
+            // Truncated or foreign bytes are rejected rather than read.
+            const auto bytes = flat.serialize();
+            ASSERT_EQ(std::get<1>(FlatDocument::deserialize(
+                          std::string_view{bytes}.substr(0, bytes.size() - 1))),
+                      Error::INVALID_SYNTAX);
+            ASSERT_EQ(std::get<1>(FlatDocument::deserialize("not a document")),
+                      Error::INVALID_SYNTAX);
+
+            // Sources too big for 32-bit offsets are refused before they are
+            // read. The file is sparse, so it takes up no room.
+            const auto huge_path = directory.path / "huge.md";
+            std::ofstream{huge_path}.close();
+            std::filesystem::resize_file(huge_path, neng::MAX_SOURCE_SIZE);
+            const CapturedErrors errors;
+            ASSERT_EQ(std::get<1>(neng::read_input(huge_path)),
+                      Error::FILE_TOO_LARGE);
+            ASSERT(errors.str().find("Too large") != std::string::npos);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "parsing big documents in parallel", TEST {
+            using neng::FlatDocument;
+
+            const auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+
+            const std::array<std::string_view, 7> pieces{
+                "# Title\n", "Some text\n", "\n",    "more text ",
+                "## Sub\n",  "   \n",       "x\n\n",
+            };
+
+            uint32_t seed = 54321;
+            const auto next_random = [&](uint32_t bound) {
+                seed = seed * 1664525 + 1013904223;
+                return (seed >> 8) % bound;
+            };
+
+            // Tiny chunks, so that every document is cut in lots of places.
+            for (int document_index = 0; document_index < 200;
+                 document_index++) {
+                std::string source;
+                const auto piece_count = next_random(60);
+                for (uint32_t i = 0; i < piece_count; i++) {
+                    source += pieces[next_random(pieces.size())];
+                }
+
+                const auto chunk_size = next_random(32) + 1;
+                const auto chunks =
+                    neng::split_at_blank_lines(source, chunk_size);
+
+                std::string joined;
+                for (const auto chunk : chunks) {
+                    joined += chunk;
+                }
+                ASSERT_EQ(joined, source);
+
+                const auto expected = Document::parse_document(source);
+                const auto expected_html =
+                    config.render_html_to_string(expected);
+
+                const auto flat =
+                    FlatDocument::parse_parallel(source, 4, chunk_size);
+                ASSERT_EQ(flat.size(), expected.paragraphs.size());
+                ASSERT_EQ(flat.get_title(), expected.get_title());
+                ASSERT_EQ(config.render_html_to_string_parallel(flat, 4,
+                                                                chunk_size),
+                          expected_html);
+            }
+
+            SUCCESS;
+        });
+
+    run_test(
+        "minifying html", TEST {
+            using neng::minify_html;
+
+            ASSERT_EQ(minify_html("<ul>\n    <li>a   b</li>\n</ul>\n"),
+                      "<ul><li>a b</li></ul> ");
+            // Without a line break, the space between two tags may be the
+            // one between two words.
+            ASSERT_EQ(minify_html("<b>bold</b>  <i>italic</i>"),
+                      "<b>bold</b> <i>italic</i>");
+            ASSERT_EQ(minify_html("<div>\n<PRE class=x>  a\n   b</PRE>\n</div>"),
+                      "<div><PRE class=x>  a\n   b</PRE></div>");
+            ASSERT_EQ(minify_html("<script>\nlet a = 1; // one\nlet b;\n"
+                                  "</script>"),
+                      "<script>\nlet a = 1; // one\nlet b;\n</script>");
+            ASSERT_EQ(minify_html("<preview>\n  x</preview>"),
+                      "<preview> x</preview>");
+            // Inline elements keep the space between them, line break or not.
+            ASSERT_EQ(minify_html("<a>x</a>\n<a>y</a>"), "<a>x</a> <a>y</a>");
+            ASSERT_EQ(minify_html("<p title=\"a  b\"\n   class='c  d'>t</p>"),
+                      "<p title=\"a  b\" class='c  d'>t</p>");
+            ASSERT_EQ(minify_html("<a title=don't>x</a>  y"),
+                      "<a title=don't>x</a> y");
+            ASSERT_EQ(minify_html("<pre>a  </prefix>  b</pre>"),
+                      "<pre>a  </prefix>  b</pre>");
+            ASSERT_EQ(minify_html("<style>a  </styles>  b</style>  c"),
+                      "<style>a  </styles>  b</style> c");
+            ASSERT_EQ(minify_html("<!-- don't  touch -->\n<p>x  < y</p>"),
+                      "<!-- don't  touch --><p>x < y</p>");
+
+            auto [document_template, error] = DocumentTemplate::from_string(
+                "<html>\n  <head><title>${{title}}</title></head>\n"
+                "  <body>\n    <textarea>\n  keep ${{body}}</textarea>\n"
+                "  </body>\n</html>");
+            ASSERT_EQ(error, Error::OK);
+            document_template.minify();
+            ASSERT_EQ(document_template.render_to_string("T", "B"),
+                      "<html><head><title>T</title></head><body><textarea>\n"
+                      "  keep B</textarea></body></html>");
+
+            auto [config, config_error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(config_error, Error::OK);
+            config.minify = true;
+
+            const auto source = "# A   title\n\nsome    text\nand <pre>a  b</pre>";
+            const auto expected = Document::parse_document(source);
+            const auto html = config.render_html_to_string(expected);
+            ASSERT(html.find("A title") != std::string::npos);
+            ASSERT(html.find("some text and <pre>a  b</pre>") !=
+                   std::string::npos);
+            ASSERT_EQ(config.render_html_to_string(
+                          neng::FlatDocument::parse(source)),
+                      html);
+            ASSERT_EQ(neng::IncrementalDocument::parse(source, config)
+                          .render_html(),
+                      html);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "fingerprinting assets", TEST {
+            using neng::AssetFingerprints;
+            namespace fs = std::filesystem;
+
+            ASSERT_EQ(neng::fnv1a_hash(""), 0xcbf29ce484222325);
+            ASSERT_EQ(neng::fnv1a_hash("a"), 0xaf63dc4c8601ec8c);
+
+            const TemporaryDirectory directory;
+            const auto &root = directory.path;
+            fs::create_directories(root / "pages/css");
+            std::ofstream{root / "pages/css/site.css"} << "a";
+            const auto cache_path = root / "cache";
+
+            auto [document_template, error] = DocumentTemplate::from_string(
+                "<link href=\"${{asset css/site.css}}\">${{body}}");
+            ASSERT_EQ(error, Error::OK);
+            ASSERT_EQ(document_template.segments[1].type,
+                      TemplateSegment::Type::ASSET);
+
+            auto [second_template, second_error] =
+                DocumentTemplate::from_string("${{ asset /css/site.css }}");
+            ASSERT_EQ(second_error, Error::OK);
+
+            {
+                AssetFingerprints fingerprints{root / "pages"};
+                fingerprints.load_cache(cache_path);
+                ASSERT_EQ(document_template.resolve_assets(fingerprints),
+                          Error::OK);
+                ASSERT_EQ(second_template.resolve_assets(fingerprints),
+                          Error::OK);
+                // Two templates, one hash.
+                ASSERT_EQ(fingerprints.hashed_count(), 1);
+                ASSERT_EQ(fingerprints.assets().size(), 1);
+                ASSERT_EQ(fingerprints.assets()[0].output,
+                          "pages/css/site.af63dc4c8601ec8c.css");
+                ASSERT_EQ(fingerprints.save_cache(cache_path), Error::OK);
+            }
+
+            ASSERT_EQ(document_template.render_to_string("", "B"),
+                      "<link href=\"/pages/css/site.af63dc4c8601ec8c.css\">B");
+            ASSERT_EQ(second_template.render_to_string("", ""),
+                      "/pages/css/site.af63dc4c8601ec8c.css");
+
+            // The next build takes the hash from the cache...
+            {
+                AssetFingerprints fingerprints{root / "pages"};
+                fingerprints.load_cache(cache_path);
+                const auto [url, resolve_error] =
+                    fingerprints.resolve("css/site.css");
+                ASSERT_EQ(resolve_error, Error::OK);
+                ASSERT_EQ(url, "/pages/css/site.af63dc4c8601ec8c.css");
+                ASSERT_EQ(fingerprints.hashed_count(), 0);
+            }
+
+            // ...unless the file has changed since.
+            std::ofstream{root / "pages/css/site.css"} << "ab";
+            {
+                AssetFingerprints fingerprints{root / "pages"};
+                fingerprints.load_cache(cache_path);
+                const auto [url, resolve_error] =
+                    fingerprints.resolve("css/site.css");
+                ASSERT_EQ(resolve_error, Error::OK);
+                ASSERT(url != "/pages/css/site.af63dc4c8601ec8c.css");
+                ASSERT_EQ(fingerprints.hashed_count(), 1);
+
+                const CapturedErrors errors;
+                ASSERT_EQ(std::get<1>(fingerprints.resolve("../secret")),
+                          Error::INVALID_SYNTAX);
+                ASSERT_EQ(std::get<1>(fingerprints.resolve("missing.js")),
+                          Error::FILE_DOES_NOT_EXIST);
+                ASSERT(errors.str().find("'../secret'") != std::string::npos);
+                ASSERT(errors.str().find("missing.js") != std::string::npos);
+            }
+
+            SUCCESS;
+        });
+
+    run_test(
+        "sharding builds", TEST {
+            using neng::BuildManifest;
+            namespace fs = std::filesystem;
+
+            const auto [shard, error] = neng::parse_shard_spec("2/4");
+            ASSERT_EQ(error, Error::OK);
+            ASSERT_EQ(shard.index, 1);
+            ASSERT_EQ(shard.count, 4);
+            for (const auto invalid : {"0/4", "5/4", "2", "a/4", "2/"}) {
+                ASSERT_EQ(std::get<1>(neng::parse_shard_spec(invalid)),
+                          Error::INVALID_SYNTAX);
+            }
+
+            std::vector<std::string> pages;
+            for (int i = 0; i < 100; i++) {
+                pages.push_back("dir" + std::to_string(i % 7) + "/page" +
+                                std::to_string(i) + ".md");
+            }
+
+            // Without a manifest, a page's shard only depends on its path.
+            const auto hashed = neng::assign_shards(pages, 4, nullptr);
+            std::vector<std::string> reversed(pages.rbegin(), pages.rend());
+            const auto hashed_reversed =
+                neng::assign_shards(reversed, 4, nullptr);
+            for (size_t i = 0; i < pages.size(); i++) {
+                ASSERT(hashed[i] < 4);
+                ASSERT_EQ(hashed[i], hashed_reversed[pages.size() - 1 - i]);
+            }
+
+            // With one, the biggest pages get spread out first.
+            BuildManifest previous;
+            for (size_t i = 0; i < pages.size(); i++) {
+                previous.pages.push_back({
+                    .input = pages[i],
+                    .output = "",
+                    .size = i < 4 ? size_t{1000} : size_t{10},
+                });
+            }
+
+            const auto balanced = neng::assign_shards(pages, 4, &previous);
+            std::array<size_t, 4> loads{};
+            for (size_t i = 0; i < pages.size(); i++) {
+                loads[balanced[i]] += previous.pages[i].size;
+            }
+            for (const auto load : loads) {
+                ASSERT_EQ(load, 1000 + 10 * 24);
+            }
+
+            // Two shards, merged back together.
+            const TemporaryDirectory directory;
+            const auto &root = directory.path;
+            for (size_t i = 0; i < 2; i++) {
+                const auto shard_path = root / ("shard" + std::to_string(i));
+                fs::create_directories(shard_path / "pages");
+                std::ofstream{shard_path / "pages" /
+                              ("page" + std::to_string(i) + ".html")}
+                    << "page " << i;
+
+                BuildManifest manifest{
+                    .shard_index = i,
+                    .shard_count = 2,
+                    .pages = {},
+                };
+                manifest.pages.push_back({
+                    .input = "page" + std::to_string(i) + ".md",
+                    .output = "pages/page" + std::to_string(i) + ".html",
+                    .size = 6,
+                });
+                ASSERT_EQ(manifest.write_to_file(shard_path /
+                                                 neng::SHARD_MANIFEST_NAME),
+                          Error::OK);
+            }
+
+            // Leftovers from earlier builds in the shards' directories.
+            std::ofstream{root / "shard0/pages/site.css"} << "asset";
+            std::ofstream{root / "shard0/pages/page1.html"} << "stale";
+            std::ofstream{root / "shard1/pages/page0.html"} << "stale";
+            std::ofstream{root / "shard1/pages/old.css"} << "stale";
+
+            {
+                const CapturedErrors errors;
+                ASSERT_EQ(neng::merge_shards({root / "shard0"}, root / "out",
+                                             root / "manifest",
+                                             neng::AssetCopyMode::COPY),
+                          Error::FILE_DOES_NOT_EXIST);
+                ASSERT(errors.str().find("Shard 2/2 is missing") !=
+                       std::string::npos);
+            }
+
+            ASSERT_EQ(neng::merge_shards({root / "shard1", root / "shard0"},
+                                         root / "out", root / "manifest",
+                                         neng::AssetCopyMode::COPY),
+                      Error::OK);
+            ASSERT(fs::exists(root / "out/pages/page0.html"));
+            ASSERT(fs::exists(root / "out/pages/page1.html"));
+            ASSERT(fs::exists(root / "out/pages/site.css"));
+            ASSERT(!fs::exists(root / "out/pages/old.css"));
+            for (const auto i : {0, 1}) {
+                std::ifstream page{root / "out/pages" /
+                                   ("page" + std::to_string(i) + ".html")};
+                std::string contents;
+                std::getline(page, contents);
+                ASSERT_EQ(contents, "page " + std::to_string(i));
+            }
+            ASSERT(!fs::exists(root / "out" / neng::SHARD_MANIFEST_NAME));
+
+            const auto [merged, merged_error] =
+                BuildManifest::from_file(root / "manifest");
+            ASSERT_EQ(merged_error, Error::OK);
+            ASSERT_EQ(merged.shard_count, 1);
+            ASSERT_EQ(merged.pages.size(), 2);
+            ASSERT_EQ(merged.pages[0].input, "page0.md");
+
+            SUCCESS;
+        });
+
+    run_test(
+        "normalizing input", TEST {
+            using neng::normalize_input;
+
+            const auto normalized = [](std::string source) {
+                const auto [position, error] = normalize_input(source);
+                return error == Error::OK ? source : "<invalid>";
+            };
+
+            ASSERT_EQ(normalized("\xEF\xBB\xBF# Title\r\n\r\ntext"),
+                      "# Title\n\ntext");
+            ASSERT_EQ(normalized("old\rmac\r\rlines\r"),
+                      "old\nmac\n\nlines\n");
+            ASSERT_EQ(normalized("caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80"),
+                      "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80");
+            // Runs of multibyte characters, moved back past a CR.
+            ASSERT_EQ(normalized("\r\n\xD0\x9F\xD1\x80\xE4\xBD\xA0"
+                                 "\xF0\x9F\x98\x80\xE5\xA5\xBD\r\n!"),
+                      "\n\xD0\x9F\xD1\x80\xE4\xBD\xA0"
+                      "\xF0\x9F\x98\x80\xE5\xA5\xBD\n!");
+            ASSERT_EQ(normalized("\r\n\xD0\x9F\xD1\xE4\xBD\xA0"),
+                      "<invalid>");
+
+            // Overlong, surrogate, out of range, truncated, stray.
+            for (const auto invalid :
+                 {"\xC0\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80",
+                  "\xE2\x82", "\x80", "\xFF"}) {
+                ASSERT_EQ(normalized(invalid), "<invalid>");
+            }
+
+            // Long enough for the 16-byte path, with the damage far in.
+            std::string source;
+            for (int line = 0; line < 40; line++) {
+                source += "A line of plain ASCII text, \xC3\xA9 included.\r\n";
+            }
+            std::string expected = source;
+            for (size_t i; (i = expected.find('\r')) != std::string::npos;) {
+                expected.erase(i, 1);
+            }
+            ASSERT_EQ(normalized(source), expected);
+
+            source.insert(source.find("\r\n", source.size() / 2) + 2,
+                          "12\xC3\xA9\xC3");
+            const auto [position, error] = normalize_input(source);
+            ASSERT_EQ(error, Error::INVALID_UTF8);
+            ASSERT_EQ(position.line, 22);
+            ASSERT_EQ(position.column, 4);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "caching rendered paragraphs", TEST {
+            using neng::FragmentCache;
+            using neng::ParagraphType;
+
+            auto [config, error] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error, Error::OK);
+            config.minify = true;
+
+            const auto first = Document::parse_document(
+                "# Page one\n\nAll rights reserved.\n\nOne.");
+            const auto second = Document::parse_document(
+                "# Page two\n\nAll rights reserved.\n\nTwo.");
+            const auto expected_first = config.render_html_to_string(first);
+            const auto expected_second = config.render_html_to_string(second);
+
+            FragmentCache cache{1 << 20};
+            config.fragment_cache = &cache;
+
+            ASSERT_EQ(config.render_html_to_string(first), expected_first);
+            ASSERT_EQ(cache.hits(), 0);
+            ASSERT_EQ(cache.misses(), 3);
+
+            ASSERT_EQ(config.render_html_to_string(second), expected_second);
+            ASSERT_EQ(cache.hits(), 1);
+
+            // The flat form shares the same fragments.
+            ASSERT_EQ(config.render_html_to_string(
+                          neng::FlatDocument::from_document(second)),
+                      expected_second);
+            ASSERT_EQ(cache.hits(), 4);
+
+            // Another configuration does not get this one's fragments.
+            auto other_config = config;
+            other_config.paragraph_class = "other";
+            ASSERT(config.render_html_to_string(first) !=
+                   other_config.render_html_to_string(first));
+
+            // A hash that collides is a miss, not somebody else's HTML.
+            std::string out;
+            cache.insert(42, ParagraphType::NORMAL, 0, "a", "<p>a</p>");
+            ASSERT(!cache.append_cached(42, ParagraphType::NORMAL, 0, "b", out));
+            ASSERT(cache.append_cached(42, ParagraphType::NORMAL, 0, "a", out));
+            ASSERT_EQ(out, "<p>a</p>");
+
+            // A cache too small to hold anything still renders correctly.
+            FragmentCache tiny_cache{16};
+            config.fragment_cache = &tiny_cache;
+            ASSERT_EQ(config.render_html_to_string(first), expected_first);
+            ASSERT_EQ(config.render_html_to_string(first), expected_first);
+            ASSERT_EQ(tiny_cache.hits(), 0);
+
+            // Plain paragraphs are copied as they are, without the cache.
+            config.minify = false;
+            const auto misses = tiny_cache.misses();
+            config.render_html_to_string(first);
+            ASSERT_EQ(tiny_cache.misses(), misses);
+
+            SUCCESS;
+        });
+
+    run_test(
+        "embedding templates", TEST {
+            using neng::DocumentTemplate;
+
+            // Whatever the embedder wrote out has to come back as exactly what
+            // parsing the file at runtime gives.
+            const auto same_output = [](const DocumentTemplate &embedded,
+                                        const DocumentTemplate &parsed) {
+                if (embedded.segments.size() != parsed.segments.size()) {
+                    return false;
+                }
+
+                for (size_t i = 0; i < parsed.segments.size(); i++) {
+                    if (embedded.segments[i].type != parsed.segments[i].type ||
+                        embedded.segments[i].a != parsed.segments[i].a) {
+                        return false;
+                    }
+                }
+
+                return embedded.render_to_string("Title", "<p>Body</p>") ==
+                       parsed.render_to_string("Title", "<p>Body</p>");
+            };
+
+            auto embedded =
+                DocumentTemplate::from_embedded(neng::TEST_EMBEDDED_TEMPLATE);
+            auto [parsed, error] =
+                DocumentTemplate::from_file("tests/embedded.html");
+            ASSERT_EQ(error, Error::OK);
+            ASSERT(same_output(embedded, parsed));
+
+            embedded.minify();
+            parsed.minify();
+            ASSERT(same_output(embedded, parsed));
+
+            // With a path, load_template always goes to the file.
+            auto [loaded, error2] = neng::load_template("tests/basic.html");
+            ASSERT_EQ(error2, Error::OK);
+            ASSERT_EQ(loaded.render_to_string("a", "b"),
+                      "Hello! Here is the title: a.\n"
+                      "And here is the body: b!\n"
+                      "Amazing, I know.");
+
+#ifdef PROCESSOR_EMBEDDED_TEMPLATE
+            auto [builtin, error3] = neng::load_template(std::nullopt);
+            ASSERT_EQ(error3, Error::OK);
+            auto [builtin_parsed, error4] = DocumentTemplate::from_file(
+                PROCESSOR_EMBEDDED_TEMPLATE_PATH);
+            ASSERT_EQ(error4, Error::OK);
+            ASSERT(same_output(builtin, builtin_parsed));
+#endif
+
+            SUCCESS;
+        });
+
+    run_test(
+        "scheduling pages longest-first", TEST {
+            using neng::ManifestPage;
+            using neng::PageStats;
+
+            const std::vector<ManifestPage> pages = {
+                {.input = "small.md", .output = "small.html", .size = 100},
+                {.input = "big.md", .output = "big.html", .size = 300},
+                {.input = "timed.md", .output = "timed.html", .size = 100},
+                {.input = "empty.md", .output = "empty.html", .size = 0},
+            };
+
+            // With nothing timed, the sizes are all there is to go on.
+            const auto by_size = neng::estimate_page_costs(pages, {});
+            ASSERT_EQ(by_size[1], 300);
+            ASSERT(neng::longest_first(by_size) ==
+                   (std::vector<size_t>{1, 0, 2, 3}));
+
+            // Otherwise untimed pages are priced at the timed pages' rate.
+            PageStats stats;
+            stats.nanoseconds["timed.md"] = 1000;
+            stats.nanoseconds["gone.md"] = 1;
+            const auto costs = neng::estimate_page_costs(pages, stats);
+            ASSERT(costs == (std::vector<uint64_t>{1000, 3000, 1000, 0}));
+            ASSERT(neng::longest_first(costs) ==
+                   (std::vector<size_t>{1, 0, 2, 3}));
+
+            ASSERT_EQ(neng::makespan_lower_bound({5, 1, 1, 1}, 2), 5);
+            ASSERT_EQ(neng::makespan_lower_bound({2, 2, 2, 2}, 2), 4);
+            ASSERT_EQ(neng::makespan_lower_bound({1, 1, 1, 1}, 3), 2);
+            ASSERT_EQ(neng::makespan_lower_bound({}, 3), 0);
+
+            const TemporaryDirectory directory;
+            const auto stats_path = directory.path / "stats";
+            ASSERT_EQ(stats.write_to_file(stats_path), Error::OK);
+            const auto [loaded, error] = PageStats::from_file(stats_path);
+            ASSERT_EQ(error, Error::OK);
+            ASSERT(loaded.nanoseconds == stats.nanoseconds);
+
+            {
+                std::ofstream file{stats_path};
+                file << "page.md\tsoon\n";
+            }
+            {
+                const CapturedErrors errors;
+                ASSERT_EQ(std::get<1>(PageStats::from_file(stats_path)),
+                          Error::INVALID_SYNTAX);
+                ASSERT(errors.str().find("Invalid syntax") !=
+                       std::string::npos);
+            }
+
+            // The pipeline times every page it renders.
+            const auto [config, error2] =
+                DocumentConfiguration::from_file("tests/basic.neng");
+            ASSERT_EQ(error2, Error::OK);
+            const auto [templ, error3] =
+                neng::DocumentTemplate::from_string("${{body}}");
+            ASSERT_EQ(error3, Error::OK);
+
+            const std::vector<neng::Page> pipeline_pages = {
+                {.input = "tests/basic.md",
+                 .output = "basic",
+                 .document_template = &templ},
+                {.input = "tests/does-not-exist.md",
+                 .output = "missing",
+                 .document_template = &templ},
+            };
+
+            neng::PipelineStats pipeline_stats;
+            const CapturedErrors errors;
+            const auto write_error = neng::run_render_pipeline(
+                pipeline_pages, config, {},
+                [](const neng::Page &, std::string_view) { return Error::OK; },
+                &pipeline_stats);
+            ASSERT_EQ(write_error, Error::OK);
+            ASSERT(errors.str().find("does-not-exist.md") != std::string::npos);
+            ASSERT_EQ(pipeline_stats.page_nanoseconds.size(), 2);
+            ASSERT(pipeline_stats.page_nanoseconds[0] > 0);
+            ASSERT_EQ(pipeline_stats.page_nanoseconds[1], 0);
+            ASSERT(pipeline_stats.render_span_nanoseconds >=
+                   pipeline_stats.page_nanoseconds[0]);
+
+            SUCCESS;
+        });
 }
 } // namespace neng